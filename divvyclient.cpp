@@ -0,0 +1,188 @@
+/* divvyclient.cpp */
+//
+// Project: Analyzing DIVVY data
+//
+// Sends commands to an analyzer running as a server (see --serve-unix and --serve-tcp in main.cpp) and prints their
+// output, so scripts and dashboards can query one loaded copy of the data. Commands are read from stdin one per line,
+// the same language as the analyzer's prompt, until "#" or the end of the input. Each response is a header line with the
+// size of the output in bytes and the server's latency in microseconds, then the output; with --latency the latency of
+// every command goes to stderr.
+//
+// Usage: divvyclient (--unix PATH | --tcp PORT) [--latency]
+//
+//
+
+
+#include <iostream>
+#include <string>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+
+using namespace std;
+
+
+//
+// connectToServer
+//
+// Given a Unix socket path (or empty) and a loopback TCP port (used if the path is empty), connects to the server.
+// Returns the socket, or -1 if the server can't be reached.
+//
+int connectToServer(const string& unixPath, int tcpPort){
+    int connection;
+    if (!unixPath.empty()){
+        sockaddr_un address;
+        memset(&address, 0, sizeof(address));
+        address.sun_family = AF_UNIX;
+        if (unixPath.size() >= sizeof(address.sun_path)){
+            return -1;
+        }
+        strcpy(address.sun_path, unixPath.c_str());
+        connection = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (connection >= 0 && connect(connection, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == 0){
+            return connection;
+        }
+    } else {
+        sockaddr_in address;
+        memset(&address, 0, sizeof(address));
+        address.sin_family = AF_INET;
+        address.sin_port = htons(tcpPort);
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        connection = socket(AF_INET, SOCK_STREAM, 0);
+        if (connection >= 0 && connect(connection, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == 0){
+            return connection;
+        }
+    }
+    if (connection >= 0){
+        close(connection);
+    }
+    return -1;
+}
+
+
+//
+// sendAll
+//
+// Given a socket and some bytes, writes all of them. Returns false if the connection is gone.
+//
+bool sendAll(int connection, const char* data, size_t size){
+    while (size > 0){
+        ssize_t sent = send(connection, data, size, MSG_NOSIGNAL);
+        if (sent < 0 && errno == EINTR){
+            continue;
+        }
+        if (sent <= 0){
+            return false;
+        }
+        data += sent;
+        size -= sent;
+    }
+    return true;
+}
+
+
+//
+// readResponse
+//
+// Given the socket, the bytes received but not used yet by reference, and the output and latency by reference, reads one
+// response: the "bytes micros" header line, then that many bytes of output. Returns false if the connection ends first.
+//
+bool readResponse(int connection, string& pending, string& output, long long& micros){
+    char buffer[65536];
+    auto receiveMore = [&](){
+        ssize_t got;
+        do {
+            got = recv(connection, buffer, sizeof(buffer), 0);
+        } while (got < 0 && errno == EINTR);
+        if (got <= 0){
+            return false;
+        }
+        pending.append(buffer, got);
+        return true;
+    };
+
+    size_t newline;
+    while ((newline = pending.find('\n')) == string::npos){
+        if (!receiveMore()){
+            return false;
+        }
+    }
+    long long bytes;
+    if (sscanf(pending.c_str(), "%lld %lld", &bytes, &micros) != 2 || bytes < 0){
+        return false;
+    }
+    pending.erase(0, newline + 1);
+
+    while ((long long)pending.size() < bytes){
+        if (!receiveMore()){
+            return false;
+        }
+    }
+    output = pending.substr(0, bytes);
+    pending.erase(0, bytes);
+    return true;
+}
+
+
+int main(int argc, char* argv[]){
+    string unixPath;
+    int tcpPort = 0;
+    bool showLatency = false;
+
+    for (int i = 1; i < argc; ++i){
+        string flag = argv[i];
+        if (flag == "--unix" && i + 1 < argc){
+            unixPath = argv[++i];
+        } else if (flag == "--tcp" && i + 1 < argc){
+            tcpPort = atoi(argv[++i]);
+        } else if (flag == "--latency"){
+            showLatency = true;
+        } else {
+            cerr << "**Error: unknown option '" << flag << "'" << endl;
+            return 1;
+        }
+    }
+    if (unixPath.empty() && (tcpPort <= 0 || tcpPort > 65535)){
+        cerr << "usage: divvyclient (--unix PATH | --tcp PORT) [--latency]" << endl;
+        return 1;
+    }
+
+    int connection = connectToServer(unixPath, tcpPort);
+    if (connection < 0){
+        cerr << "**Error: unable to connect to " << (unixPath.empty() ? "127.0.0.1:" + to_string(tcpPort) : unixPath) << endl;
+        return 1;
+    }
+
+    string line, pending, output;
+    while (getline(cin, line)){
+        size_t first = line.find_first_not_of(" \t\r");
+        if (first == string::npos){
+            continue;
+        }
+        if (line.compare(first, 1, "#") == 0){
+            break;
+        }
+
+        line += '\n';
+        long long micros;
+        if (!sendAll(connection, line.data(), line.size()) || !readResponse(connection, pending, output, micros)){
+            cerr << "**Error: the server closed the connection" << endl;
+            close(connection);
+            return 1;
+        }
+        cout << output << flush;
+        if (showLatency){
+            cerr << " " << line.substr(first, line.size() - first - 1) << ": " << micros / 1000.0 << " ms" << endl;
+        }
+    }
+
+    close(connection);
+    return 0;
+}
@@ -0,0 +1,251 @@
+/* divvygen.cpp */
+//
+// Project: Analyzing DIVVY data
+//
+// Generates synthetic stations and bike trips files in the same format as stations.txt and biketrips.txt, at any scale,
+// for benchmarking the analyzer (see --bench in main.cpp). The data is random but shaped like the real thing: stations
+// cluster around downtown Chicago and some are much busier than others, trips start mostly in the morning and evening
+// rush hours, and durations are log-normal (about 12 minutes typical) with a tail of multi-hour rentals. With --days N the
+// trips get full timestamps spread over N days from 2021-03-01, written in start time order like Divvy's own files.
+//
+// Usage: divvygen --stations N --trips N [--days N] [--seed N] [--out-stations F] [--out-trips F]
+//
+//
+
+
+#include <iostream>
+#include <string>
+#include <cstdio>
+#include <cmath>
+#include <vector>
+#include <random>
+#include <algorithm>
+
+using namespace std;
+
+
+// a generated station, as written to the stations file
+struct genStation{
+    string id;
+    int capacity;
+    double latitude;
+    double longitude;
+    string name;
+};
+
+
+//
+// parseCount
+//
+// Given a command-line argument and a long long by reference, parses a positive count. Returns false if it isn't one.
+//
+bool parseCount(const string& arg, long long& value){
+    try {
+        size_t used;
+        value = stoll(arg, &used);
+        return used == arg.size() && value > 0;
+    } catch (const exception&) {
+        return false;
+    }
+}
+
+
+//
+// makeStations
+//
+// Given the number of stations(S), the random engine, and a vector of genStation by reference, generates S stations.
+// Most are scattered around downtown with a normal spread and the rest uniformly over the city. Names are a north-south
+// street and an east-west street, with a number added once every pair is used. No return type.
+//
+void makeStations(long long S, mt19937_64& engine, vector<genStation>& stations){
+    static const char* northSouth[] = {"State", "Clark", "Halsted", "Ashland", "Damen", "Western", "California", "Kedzie",
+                                       "Pulaski", "Cicero", "Michigan", "Wabash", "Wells", "LaSalle", "Racine", "Sheffield",
+                                       "Larrabee", "Wolcott", "Leavitt", "Central Park", "Kostner", "Lake Shore", "Broadway",
+                                       "Sheridan", "Milwaukee", "Elston", "Lincoln", "Clybourn", "Ogden", "Archer"};
+    static const char* eastWest[] = {"Madison", "Lake", "Division", "North", "Armitage", "Fullerton", "Diversey", "Belmont",
+                                     "Addison", "Irving Park", "Montrose", "Lawrence", "Foster", "Devon", "Roosevelt",
+                                     "Cermak", "18th", "21st", "35th", "47th", "57th", "63rd", "Chicago", "Grand", "Kinzie",
+                                     "Hubbard", "Randolph", "Monroe", "Van Buren", "Harrison"};
+    const int numNorthSouth = sizeof(northSouth) / sizeof(northSouth[0]);
+    const int numEastWest = sizeof(eastWest) / sizeof(eastWest[0]);
+
+    normal_distribution<double> downtownLat(41.88, 0.05), downtownLong(-87.64, 0.04);
+    uniform_real_distribution<double> cityLat(41.65, 42.07), cityLong(-87.85, -87.52), unit(0.0, 1.0);
+    uniform_int_distribution<int> capacity(11, 43);
+
+    stations.resize(S);
+    for (long long i = 0; i < S; ++i){
+        genStation& station = stations[i];
+        station.id = "S" + to_string(1000 + i);
+        station.capacity = capacity(engine);
+        if (unit(engine) < 0.6){
+            station.latitude = downtownLat(engine);
+            station.longitude = downtownLong(engine);
+        } else {
+            station.latitude = cityLat(engine);
+            station.longitude = cityLong(engine);
+        }
+
+        long long pair = i % (numNorthSouth * numEastWest);
+        station.name = string(northSouth[pair % numNorthSouth]) + " & " + eastWest[pair / numNorthSouth];
+        if (i >= numNorthSouth * numEastWest){
+            station.name += " " + to_string(i / (numNorthSouth * numEastWest) + 1);
+        }
+    }
+}
+
+
+//
+// writeStations
+//
+// Given the output file name and the stations, writes the stations file: the count, then one station per line.
+// Returns false if the file can't be written.
+//
+bool writeStations(const string& fileName, const vector<genStation>& stations){
+    FILE* out = fopen(fileName.c_str(), "w");
+    if (out == nullptr){
+        return false;
+    }
+    fprintf(out, "%zu\n", stations.size());
+    for (const genStation& station : stations){
+        fprintf(out, "%s %d %.6f %.6f %s\n", station.id.c_str(), station.capacity, station.latitude, station.longitude, station.name.c_str());
+    }
+    return fclose(out) == 0;
+}
+
+
+//
+// writeTrips
+//
+// Given the output file name, the number of trips(T), the number of days (0 for times of day only), the stations, and the
+// random engine, writes the trips file: the count, then one "tripID bikeID startStation endStation duration H:MM" line per
+// trip, or "... duration YYYY-MM-DD H:MM:SS" with days. Start stations are picked with a Zipf-like popularity, 5% of trips
+// return to their start station, start hours follow a weekday Divvy profile and durations are log-normal with 2% long
+// rentals of 1 to 8 hours. Dated trips are spread evenly over the days, in order. Returns false if the file can't be
+// written.
+//
+bool writeTrips(const string& fileName, long long T, long long days, const vector<genStation>& stations, mt19937_64& engine){
+    FILE* out = fopen(fileName.c_str(), "w");
+    if (out == nullptr){
+        return false;
+    }
+
+    // relative number of trips starting in each hour (two commute peaks, busy afternoons, quiet nights)
+    static const double hourWeights[24] = {0.6, 0.35, 0.2, 0.12, 0.1, 0.3, 1.2, 3.0, 4.8, 3.0, 2.6, 3.2,
+                                           3.8, 3.8, 3.8, 4.4, 6.0, 8.0, 6.2, 4.3, 3.0, 2.2, 1.6, 1.0};
+    discrete_distribution<int> hour(hourWeights, hourWeights + 24);
+    uniform_int_distribution<int> minute(0, 59);
+    uniform_int_distribution<int> second(0, 59);
+
+    vector<double> popularity(stations.size());
+    for (size_t i = 0; i < stations.size(); ++i){
+        popularity[i] = 1.0 / pow(i + 1.0, 0.8);
+    }
+    shuffle(popularity.begin(), popularity.end(), engine); // so the busy stations aren't all the first ones
+    discrete_distribution<size_t> station(popularity.begin(), popularity.end());
+
+    lognormal_distribution<double> typicalDuration(log(720.0), 0.75);
+    uniform_int_distribution<int> longDuration(3600, 8 * 3600);
+    uniform_real_distribution<double> unit(0.0, 1.0);
+    uniform_int_distribution<long long> bike(1, max(100LL, (long long)stations.size() * 6));
+
+    vector<char> buffer(1 << 20);
+    size_t used = 0;
+    used += snprintf(buffer.data(), buffer.size(), "%lld\n", T);
+    long long j = 0;
+    for (long long day = 0; day < max(days, 1LL); ++day){
+        // a day's start times are drawn up front and sorted, so the file is in start time order
+        long long tripsToday = T * (day + 1) / max(days, 1LL) - j;
+        vector<int> startSeconds(tripsToday);
+        for (int& seconds : startSeconds){
+            seconds = hour(engine) * 3600 + minute(engine) * 60 + second(engine);
+        }
+        if (days > 0){
+            sort(startSeconds.begin(), startSeconds.end());
+        }
+
+        // 2021-03-01 plus day, as a calendar date
+        static const int daysInMonth[12] = {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+        int year = 2021, month = 2, dayOfMonth = (int)day; // month 0-based, day 0-based
+        while (dayOfMonth >= daysInMonth[month] + (month == 1 && year % 4 == 0)){
+            dayOfMonth -= daysInMonth[month] + (month == 1 && year % 4 == 0);
+            if (++month == 12){
+                month = 0;
+                year++;
+            }
+        }
+
+        for (int startSecond : startSeconds){
+            size_t start = station(engine);
+            size_t end = (unit(engine) < 0.05) ? start : station(engine);
+            int duration = (unit(engine) < 0.02) ? longDuration(engine) : max(60, (int)typicalDuration(engine));
+
+            if (buffer.size() - used < 256){
+                fwrite(buffer.data(), 1, used, out);
+                used = 0;
+            }
+            used += snprintf(buffer.data() + used, buffer.size() - used, "%lld %lld %s %s %d ", 10000000 + j, bike(engine),
+                             stations[start].id.c_str(), stations[end].id.c_str(), duration);
+            if (days > 0){
+                used += snprintf(buffer.data() + used, buffer.size() - used, "%04d-%02d-%02d %d:%02d:%02d\n", year, month + 1,
+                                 dayOfMonth + 1, startSecond / 3600, startSecond / 60 % 60, startSecond % 60);
+            } else {
+                used += snprintf(buffer.data() + used, buffer.size() - used, "%d:%02d\n", startSecond / 3600, startSecond / 60 % 60);
+            }
+            j++;
+        }
+    }
+    fwrite(buffer.data(), 1, used, out);
+    return fclose(out) == 0;
+}
+
+
+int main(int argc, char* argv[]){
+    long long numOfStations = 0;
+    long long numOfTrips = 0;
+    long long numOfDays = 0;
+    long long seed = 2021;
+    string stationsFileName = "stations-gen.txt";
+    string biketripsFileName = "biketrips-gen.txt";
+
+    for (int i = 1; i < argc; ++i){
+        string flag = argv[i];
+        if (flag == "--stations" && i + 1 < argc && parseCount(argv[i + 1], numOfStations)){
+            ++i;
+        } else if (flag == "--trips" && i + 1 < argc && parseCount(argv[i + 1], numOfTrips)){
+            ++i;
+        } else if (flag == "--days" && i + 1 < argc && parseCount(argv[i + 1], numOfDays)){
+            ++i;
+        } else if (flag == "--seed" && i + 1 < argc && parseCount(argv[i + 1], seed)){
+            ++i;
+        } else if (flag == "--out-stations" && i + 1 < argc){
+            stationsFileName = argv[++i];
+        } else if (flag == "--out-trips" && i + 1 < argc){
+            biketripsFileName = argv[++i];
+        } else {
+            cerr << "**Error: unknown option '" << flag << "'" << endl;
+            return 1;
+        }
+    }
+    if (numOfStations == 0 || numOfTrips == 0){
+        cerr << "usage: divvygen --stations N --trips N [--days N] [--seed N] [--out-stations F] [--out-trips F]" << endl;
+        return 1;
+    }
+
+    mt19937_64 engine(seed);
+    vector<genStation> stations;
+    makeStations(numOfStations, engine, stations);
+
+    if (!writeStations(stationsFileName, stations)){
+        cerr << "**Error: unable to write '" << stationsFileName << "'" << endl;
+        return 1;
+    }
+    if (!writeTrips(biketripsFileName, numOfTrips, numOfDays, stations, engine)){
+        cerr << "**Error: unable to write '" << biketripsFileName << "'" << endl;
+        return 1;
+    }
+
+    cerr << " wrote " << numOfStations << " stations to " << stationsFileName << " and " << numOfTrips << " trips to ";
+    cerr << biketripsFileName << endl;
+    return 0;
+}
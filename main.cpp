@@ -7,694 +7,5833 @@
 // The program analyzes the DIVYY bike trips data and stations. It stores the stations data and bike trips data
 // in dynamically allocated arrays. It does the following operations when user enters a specific command until user inputs "#".
 // 1. Quick statistics (command: stats)
-// 2. Summary of bike duration (command: durations)
-// 3. Histogram of starting times (command: starting)
+// 2. Summary of bike duration (command: durations, or durations 2021-03-01 2021-03-07 for the trips in a date range;
+//    durations 5m or durations 10,30,90m for other bins)
+// 3. Histogram of starting times (command: starting, or starting 2021-03-01 2021-03-07; starting 15m for 15 minute bins)
 // 4. Stations near me (example command: nearme 41.87 -87.66 0.8) Lists stations by ascending order of distance near given position.
 // 5. List all stations (command: stations)
 // 6. Find stations (example command: find Park). Lists stations alphabetically that contains case-sensitive string in station's name. 
-// 7. Find trips within timespan (example command: trips 2:00 5:00)
+// 7. Find trips within timespan (example commands: trips 2:00 5:00, trips 2:00 5:00 2021-03-01 2021-03-07 for the
+//    days of a date range)
+// 8. Add new trips from a trips file (example command: append biketrips.txt). Only lines not read before are added.
+// 9. Top routes (example commands: routes 10, routesfrom 341X2 5, routesbetween 7:00 9:00 10) Lists the K start -> end
+//    station pairs with the most trips: overall, from one station, or starting in a time span.
+// 10. Bikes (example commands: bike 1234, idlebikes 10, lastat 341X2) One bike's trips, minutes ridden, utilization and
+//     longest idle gap; the K bikes idle the longest; or the bikes whose last trip ended at a station.
+// 11. Result cache (command: cache) Number of cached results, their size, and cache hits and misses so far.
 //
 //
 
 
 #include <iostream>
 #include <fstream>
+#include <sstream>
 #include <string>
+#include <string_view>
 #include <cmath>
+#include <cstring>
+#include <cstdint>
+#include <climits>
+#include <chrono>
+#include <unordered_map>
+#include <list>
+#include <vector>
+#include <algorithm>
+#include <iterator>
+#include <utility>
+#include <array>
+#include <thread>
+#include <atomic>
+#include <memory>
+#include <random>
+#include <mutex>
+#include <shared_mutex>
+#include <condition_variable>
+#include <future>
+#include <functional>
+#include <csignal>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#include <immintrin.h>
+#define DIVVY_AVX2_KERNELS 1 // AVX2 versions of the scan kernels, picked at runtime if the CPU supports them
+#endif
+
+#ifdef DIVVY_PROFILE // build with -DDIVVY_PROFILE for the timers and counters (see profiling)
+#include <sys/resource.h>
+#endif
 
 
 using namespace std;
 
 
+// stationID and name point into a textArena (or a mapped snapshot), so a station owns no heap memory of its own
 struct stationInfo{
-    string stationID;
+    string_view stationID;
     int capacity;
     double latitude;
     double longitude;
-    string name;
-    double distance;
-    int trips;
-    bool tripFound;
+    string_view name;
+    int index; // dense station index from the station dictionary
+};
+
+
+// an array of numbers (a trip column, or an index over the trips) that either owns its elements, in rows, or is borrowed:
+// it reads them in place out of a mapped snapshot. view and count point at whichever holds them, so reading costs the
+// same as a vector. Anything that changes a borrowed array copies it into rows first, so a snapshot's arrays are only
+// copied once trips are added to them
+template <typename T>
+struct columnArray{
+    vector<T> rows;
+    const T* view = nullptr;
+    size_t count = 0;
+    bool borrowed = false;
+    
+    columnArray() = default;
+    columnArray(const columnArray& other) : rows(other.rows), view(other.view), count(other.count), borrowed(other.borrowed){
+        sync();
+    }
+    columnArray(columnArray&& other) noexcept : rows(move(other.rows)), view(other.view), count(other.count), borrowed(other.borrowed){
+        other.clear();
+    }
+    columnArray& operator=(columnArray other) noexcept{
+        swap(other);
+        return *this;
+    }
+    
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+    const T* data() const { return view; }
+    const T* begin() const { return view; }
+    const T* end() const { return view + count; }
+    const T& operator[](size_t i) const { return view[i]; }
+    size_t capacity() const { return borrowed ? count : rows.capacity(); }
+    
+    // points the array at count elements of a mapped snapshot
+    void borrow(const T* elements, size_t n){
+        vector<T>().swap(rows);
+        view = elements;
+        count = n;
+        borrowed = true;
+    }
+    // the elements, writable; a borrowed array is copied into rows first
+    T* ownedData(){
+        own();
+        return rows.data();
+    }
+    void reserve(size_t n){ own(); rows.reserve(n); sync(); }
+    void resize(size_t n){ own(); rows.resize(n); sync(); }
+    void clear(){ borrowed = false; rows.clear(); sync(); }
+    void push_back(const T& value){ own(); rows.push_back(value); sync(); }
+    void assign(const T* first, const T* last){ borrowed = false; rows.assign(first, last); sync(); }
+    void append(const columnArray& from){ own(); rows.insert(rows.end(), from.begin(), from.end()); sync(); }
+    void swap(columnArray& other){
+        rows.swap(other.rows);
+        std::swap(view, other.view);
+        std::swap(count, other.count);
+        std::swap(borrowed, other.borrowed);
+    }
+    // takes other's elements, leaving it with the old ones (borrowed ones are copied first)
+    void swap(vector<T>& other){ own(); rows.swap(other); sync(); }
+    
+    void own(){
+        if (borrowed){
+            rows.assign(view, view + count);
+            borrowed = false;
+            sync();
+        }
+    }
+    void sync(){
+        if (!borrowed){
+            view = rows.data();
+            count = rows.size();
+        }
+    }
+};
+
+
+// a text column of the trips: string j is views[j], or for a column borrowed from a mapped snapshot, the string pool's
+// bytes pool[offsets[j] .. offsets[j+1]). Like columnArray, a borrowed column is turned into views before it's changed
+struct textColumn{
+    vector<string_view> views;
+    const char* pool = nullptr;
+    const uint64_t* offsets = nullptr;
+    size_t count = 0;
+    bool borrowed = false;
+    
+    size_t size() const { return borrowed ? count : views.size(); }
+    bool empty() const { return size() == 0; }
+    string_view operator[](size_t j) const {
+        return borrowed ? string_view(pool + offsets[j], offsets[j + 1] - offsets[j]) : views[j];
+    }
+    size_t capacity() const { return borrowed ? count : views.capacity(); }
+    
+    void borrow(const char* stringPool, const uint64_t* stringOffsets, size_t n){
+        vector<string_view>().swap(views);
+        pool = stringPool;
+        offsets = stringOffsets;
+        count = n;
+        borrowed = true;
+    }
+    string_view* ownedData(){
+        own();
+        return views.data();
+    }
+    void reserve(size_t n){ own(); views.reserve(n); }
+    void resize(size_t n){ own(); views.resize(n); }
+    void clear(){ borrowed = false; views.clear(); }
+    void push_back(string_view text){ own(); views.push_back(text); }
+    void append(const textColumn& from){
+        own();
+        if (from.borrowed){
+            for (size_t j = 0; j < from.count; ++j){
+                views.push_back(from[j]);
+            }
+        } else {
+            views.insert(views.end(), from.views.begin(), from.views.end());
+        }
+    }
+    void swap(textColumn& other){
+        views.swap(other.views);
+        std::swap(pool, other.pool);
+        std::swap(offsets, other.offsets);
+        std::swap(count, other.count);
+        std::swap(borrowed, other.borrowed);
+    }
+    void swap(vector<string_view>& other){ own(); views.swap(other); }
+    
+    void own(){
+        if (borrowed){
+            views.resize(count);
+            for (size_t j = 0; j < count; ++j){
+                views[j] = string_view(pool + offsets[j], offsets[j + 1] - offsets[j]);
+            }
+            borrowed = false;
+        }
+    }
+};
+
+
+// trips stored column by column (struct of arrays) so a scan only pulls in the fields it uses.
+// text columns are views into the mapped bike trips file, which stays mapped until the program exits.
+// start and end stations are dense indices into the station dictionary, startMins is -1 if the time was invalid.
+// startEpoch is the start as seconds since 1970-01-01 00:00 (the timestamp's own clock, no time zone) for trips with a
+// date, -1 for trips that only have a time of day or an invalid time. Columns loaded from a snapshot are borrowed from it
+// (see columnArray)
+struct tripColumns{
+    columnArray<int> duration;
+    columnArray<short> startMins;
+    columnArray<int64_t> startEpoch;
+    columnArray<int> startStation;
+    columnArray<int> endStation;
+    textColumn tripID;
+    textColumn bikeID;
+    textColumn startTime;
+};
+
+
+// number of trips at each station, by station index. A trip counts for its start station and its end station (once if
+// they're the same). countedTrips is how many rows of the trip columns are already included, so when trips are appended
+// only the new rows need to be counted
+struct stationTripCounts{
+    vector<int> trips;
+    int countedTrips;
+};
+
+
+// per-minute index over trip start times (minute 0..1439 of the day). tripsBefore[m] and secondsBefore[m] are prefix sums
+// of the number of trips and their total duration for trips starting before minute m. The distinct start stations of
+// minute m are minuteStations[minuteOffsets[m] .. minuteOffsets[m+1])
+struct timeIndex{
+    long long tripsBefore[1441];
+    long long secondsBefore[1441];
+    vector<int> minuteOffsets;
+    vector<int> minuteStations;
+};
+
+
+// uniform latitude/longitude grid over the station positions, built once at load. Cell (row, col) covers
+// [minLat + row * cellSize, minLat + (row+1) * cellSize) and the same for longitude; the positions (in the stations
+// array) of the stations inside cell c are cellStations[cellOffsets[c] .. cellOffsets[c+1]). unitX/Y/Z hold the point on
+// the unit sphere of station cellStations[k] at k (cos(lat)cos(long), cos(lat)sin(long), sin(lat)), so the stations of a
+// run of cells are one contiguous range for the distance kernel
+struct stationGrid{
+    double minLat;
+    double minLong;
+    double cellSize; // degrees
+    int rows;
+    int cols;
+    vector<int> cellOffsets;
+    vector<int> cellStations;
+    vector<double> unitX;
+    vector<double> unitY;
+    vector<double> unitZ;
+};
+
+
+// trigram index over station names for the find command. A station's rank is its position in the name order.
+// gramKeys holds every distinct 3-byte substring of the names (packed into 24 bits) in increasing order, and the ranks of
+// the stations whose name contains gramKeys[g] are gramRanks[gramOffsets[g] .. gramOffsets[g+1]), in increasing rank,
+// so a list of matching ranks is already in name order
+struct nameIndex{
+    vector<uint32_t> gramKeys;
+    vector<int> gramOffsets;
+    vector<int> gramRanks;
+};
+
+
+// bump-pointer arena for text that lives as long as the dataset. Text is copied into the current block until it's full,
+// then a new block twice as big is started; blocks are never moved or freed one at a time, so views into them stay valid
+// until the arena itself goes away, which frees every block at once
+struct textArena{
+    vector<unique_ptr<char[]>> blocks;
+    char* next = nullptr;
+    size_t left = 0;
+    size_t lastBlockSize = 0;
+};
+
+
+// a run of trip rows that start on the same day: rows [begin, end), in startEpoch order, starting on day (days since
+// 1970-01-01), the earliest and latest start being minStart and maxStart. The rows of a load, or of an append, are sorted
+// by start time, so every day is one partition (or a few, after appends) and a date range skips every partition whose
+// [minStart, maxStart] misses it without looking at its rows. Trips without a date are in partitions with day -1, which
+// date ranges never match
+struct tripPartition{
+    int day;
+    int begin;
+    int end;
+    int64_t minStart;
+    int64_t maxStart;
+};
+
+
+// origin-destination matrix: trips counted per (start station, end station) route, by station index. A route's id is its
+// position in routeStart/routeEnd/routeTrips. The routes of the rows the matrix was built from are in compressed sparse
+// rows: ids routeOffsets[s] .. routeOffsets[s+1] are the routes from start station s, ordered by end station. An appended
+// trip on one of those routes just adds to its count; a route first seen in an append gets the next id, is found again
+// through addedRoutes (keyed by start << 32 | end) and is listed under its start station in addedFrom. routesByMinute
+// holds the route id of every built trip with a valid start time, grouped by start minute: minute m's are
+// routesByMinute[minuteOffsets[m] .. minuteOffsets[m+1]), and appended trips' are in addedByMinute[m] (both empty in
+// streaming mode, where the trips aren't kept). builtTrips and appendedTrips count the trips the matrix was built from
+// and added to it since
+struct routeMatrix{
+    vector<int> routeOffsets;
+    vector<int> routeStart;
+    vector<int> routeEnd;
+    vector<int> routeTrips;
+    vector<int> minuteOffsets;
+    columnArray<int> routesByMinute;
+    unordered_map<uint64_t, int> addedRoutes;
+    vector<vector<int>> addedFrom;
+    vector<vector<int>> addedByMinute;
+    int builtTrips;
+    int appendedTrips;
+};
+
+
+// per-bike timeline. Every bike ID is interned to a dense bike index in order of first appearance. The rows of the load
+// (or snapshot) are bike b's bikeTrips[bikeOffsets[b] .. bikeOffsets[b+1]) and the rows appended since are addedTrips[b],
+// both in start time order: trips with an invalid start time first, then trips with only a time of day by minute, then
+// dated trips by startEpoch. rideSeconds, longestIdle (seconds between the end of a trip and the start of the bike's next
+// one), firstStart and lastFinish (the start of its first trip and the latest end of its trips, as seconds since 1970 if
+// its trips have dates and seconds into the day if not, -1 if none of its trips has a valid start), lastRow (its last
+// trip's row) and lastEnd (station index where that trip ended) are kept up to date trip by trip, so an append only
+// touches the bikes it has trips for. lastAt[s] holds the bikes whose last trip ended at station index s, in bike index
+// order. The IDs point into the trips file or snapshot, like tripColumns.bikeID (empty in streaming mode)
+struct bikeTimeline{
+    unordered_map<string_view, int> indexOf;
+    vector<string_view> bikeIDs;
+    vector<int> bikeOffsets;
+    columnArray<int> bikeTrips;
+    vector<vector<int>> addedTrips;
+    vector<long long> rideSeconds;
+    vector<int> longestIdle;
+    vector<long long> firstStart;
+    vector<long long> lastFinish;
+    vector<int> lastRow;
+    vector<int> lastEnd;
+    vector<vector<int>> lastAt;
+};
+
+
+// the indexes built over the stations and trips after they're loaded. A snapshot stores them next to the data, so
+// loading one skips building them (see snapshot format)
+struct datasetIndexes{
+    vector<int> nameOrder;
+    nameIndex names;
+    vector<tripPartition> partitions;
+    stationTripCounts stationTrips;
+    timeIndex tripTimes;
+    routeMatrix routes;
+    bikeTimeline bikes;
+};
+
+
+// working memory for one query. Commands only read the dataset, and anything a query has to write (distance buffers,
+// found flags, candidate lists, per-route counters) goes here instead. Every thread has its own (see threadScratch), so
+// any number of queries can run at once on one copy of the data without locks, and the buffers keep their capacity from
+// one query to the next. routeTrips is all zeros between queries; the routes a query counts are listed in touched so
+// only those are reset. bestRoutes holds top routes by route key (see routeKey)
+struct queryScratch{
+    vector<pair<int, int>> ranges;
+    vector<pair<int, int>> rowRanges;
+    vector<int> hits;
+    vector<double> dots;
+    vector<pair<double, int>> nearby;
+    vector<int> candidates;
+    vector<int> kept;
+    vector<int> matches;
+    unique_ptr<bool[]> stationFlags;
+    size_t numStationFlags = 0;
+    vector<int> routeTrips;
+    vector<int> touched;
+    vector<pair<int, int>> best;
+    vector<pair<int, uint64_t>> bestRoutes;
+};
+
+
+// maps every station ID string to a dense index. Stations from the stations file get indices 0..S-1 in load order,
+// IDs that only show up in the trips file are appended after them. The ids and the map keys point into text
+struct stationDictionary{
+    unordered_map<string_view, int> indexOf;
+    vector<string_view> ids;
+    textArena text;
+};
+
+
+// an input file (or the rest of one, from some byte on) mapped read-only into memory, or read into a heap buffer when it
+// cannot be mapped. A mapping starts on a page boundary, mapOffset bytes before data
+struct mappedFile{
+    const char* data;
+    size_t size;
+    bool isMapped;
+    size_t mapOffset;
+};
+
+
+#ifdef DIVVY_PROFILE
+//
+// profiling
+//
+// Built only with -DDIVVY_PROFILE; otherwise PROFILE_SCOPE and PROFILE_COUNT expand to nothing and release builds pay
+// nothing for them. PROFILE_SCOPE(timer) times the rest of the enclosing block into one of the profileTimerID slots and
+// PROFILE_COUNT(counter, n) adds n to a counter. Both are relaxed atomics, so batch mode workers can share them; hot loops
+// add their count once per call instead of once per item. Every allocation through operator new is counted too.
+//
+enum profileTimerID{
+    PROF_STORE_STATIONS,
+    PROF_STORE_TRIPS,
+    PROF_LOAD_SNAPSHOT,
+    PROF_CMD_STATS,
+    PROF_CMD_DURATIONS,
+    PROF_CMD_STARTING,
+    PROF_CMD_NEARME,
+    PROF_CMD_STATIONS,
+    PROF_CMD_FIND,
+    PROF_CMD_TRIPS,
+    PROF_CMD_ROUTES,
+    PROF_CMD_BIKES,
+    PROF_NUM_TIMERS
+};
+
+const char* PROFILE_TIMER_NAMES[PROF_NUM_TIMERS] = {
+    "storeStationValues", "storeBikeTripValues", "loadSnapshot",
+    "stats", "durations", "starting", "nearme", "stations", "find", "trips", "routes", "bikes"
+};
+
+enum profileCounterID{
+    PROF_ROWS_PARSED,
+    PROF_BYTES_READ,
+    PROF_DISTANCE_EVALS,
+    PROF_STRING_COMPARES,
+    PROF_ALLOCATIONS,
+    PROF_NUM_COUNTERS
+};
+
+const char* PROFILE_COUNTER_NAMES[PROF_NUM_COUNTERS] = {
+    "rows parsed", "bytes read", "distance evaluations", "string compares", "allocations"
+};
+
+struct profileTimer{
+    atomic<long long> calls;
+    atomic<long long> totalNanos;
+    atomic<long long> maxNanos;
+};
+
+profileTimer profileTimers[PROF_NUM_TIMERS];
+atomic<long long> profileCounters[PROF_NUM_COUNTERS];
+
+
+// adds the time from its construction to the end of its scope to a profileTimer
+struct profileScope{
+    profileTimerID timer;
+    chrono::steady_clock::time_point start;
+    
+    profileScope(profileTimerID id) : timer(id), start(chrono::steady_clock::now()){}
+    
+    ~profileScope(){
+        long long nanos = chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count();
+        profileTimer& slot = profileTimers[timer];
+        slot.calls.fetch_add(1, memory_order_relaxed);
+        slot.totalNanos.fetch_add(nanos, memory_order_relaxed);
+        long long seen = slot.maxNanos.load(memory_order_relaxed);
+        while (nanos > seen && !slot.maxNanos.compare_exchange_weak(seen, nanos, memory_order_relaxed)){
+        }
+    }
+};
+
+#define PROFILE_SCOPE(timer) profileScope profileScopeTimer(timer)
+#define PROFILE_COUNT(counter, n) profileCounters[counter].fetch_add((n), memory_order_relaxed)
+
+
+// noinline so GCC doesn't see malloc() and free() paired with operator new and delete and warn about a mismatch
+__attribute__((noinline)) void* operator new(size_t size){
+    PROFILE_COUNT(PROF_ALLOCATIONS, 1);
+    void* memory = malloc(size > 0 ? size : 1);
+    if (memory == nullptr){
+        throw bad_alloc();
+    }
+    return memory;
+}
+
+__attribute__((noinline)) void operator delete(void* memory) noexcept{
+    free(memory);
+}
+
+__attribute__((noinline)) void operator delete(void* memory, size_t) noexcept{
+    free(memory);
+}
+
+
+//
+// profileReport
+//
+// Given the output stream and whether to write JSON, outputs every timer (calls, total, average and max milliseconds),
+// every counter, and the peak resident set size, as a table or as one JSON object. No return type.
+//
+void profileReport(ostream& out, bool json){
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    long long peakRSSKB = usage.ru_maxrss; // kilobytes on Linux
+    
+    if (json){
+        out << "{\"timers\": {";
+        for (int t = 0; t < PROF_NUM_TIMERS; ++t){
+            long long calls = profileTimers[t].calls.load();
+            double totalMs = profileTimers[t].totalNanos.load() / 1e6;
+            out << (t > 0 ? ", " : "") << "\"" << PROFILE_TIMER_NAMES[t] << "\": {\"calls\": " << calls << ", \"total_ms\": " << totalMs;
+            out << ", \"avg_ms\": " << (calls > 0 ? totalMs / calls : 0.0) << ", \"max_ms\": " << profileTimers[t].maxNanos.load() / 1e6 << "}";
+        }
+        out << "}, \"counters\": {";
+        for (int c = 0; c < PROF_NUM_COUNTERS; ++c){
+            out << (c > 0 ? ", " : "") << "\"" << PROFILE_COUNTER_NAMES[c] << "\": " << profileCounters[c].load();
+        }
+        out << "}, \"peak_rss_kb\": " << peakRSSKB << "}" << endl;
+        return;
+    }
+    
+    out << " timer                 calls      total ms        avg ms        max ms" << endl;
+    for (int t = 0; t < PROF_NUM_TIMERS; ++t){
+        long long calls = profileTimers[t].calls.load();
+        double totalMs = profileTimers[t].totalNanos.load() / 1e6;
+        char line[128];
+        snprintf(line, sizeof(line), " %-20s %6lld %13.3f %13.3f %13.3f", PROFILE_TIMER_NAMES[t], calls, totalMs,
+                 calls > 0 ? totalMs / calls : 0.0, profileTimers[t].maxNanos.load() / 1e6);
+        out << line << endl;
+    }
+    for (int c = 0; c < PROF_NUM_COUNTERS; ++c){
+        out << " " << PROFILE_COUNTER_NAMES[c] << ": " << profileCounters[c].load() << endl;
+    }
+    out << " peak RSS: " << peakRSSKB << " KB" << endl;
+}
+
+
+//
+// profileAtExit
+//
+// Writes the profile to cerr, as JSON if the DIVVY_PROFILE environment variable is "json" and as a table otherwise.
+// Registered with atexit by main when DIVVY_PROFILE is set. No return type.
+//
+void profileAtExit(){
+    const char* format = getenv("DIVVY_PROFILE");
+    profileReport(cerr, format != nullptr && strcmp(format, "json") == 0);
+}
+#else
+#define PROFILE_SCOPE(timer)
+#define PROFILE_COUNT(counter, n)
+#endif
+
+
+
+//
+// arenaReserve
+//
+// Given a textArena by reference and a number of bytes, makes sure the next that many bytes of text fit in the current
+// block, starting a new block (at least 64 KB, and at least double the last one) if they don't. No return type.
+//
+void arenaReserve(textArena& arena, size_t bytes){
+    if (bytes <= arena.left){
+        return;
+    }
+    size_t blockSize = max(max(bytes, (size_t)1 << 16), 2 * arena.lastBlockSize);
+    arena.blocks.emplace_back(new char[blockSize]);
+    arena.next = arena.blocks.back().get();
+    arena.left = blockSize;
+    arena.lastBlockSize = blockSize;
+}
+
+
+//
+// arenaCopy
+//
+// Given a textArena by reference and some text, copies the text into the arena and returns a view of the copy.
+//
+string_view arenaCopy(textArena& arena, string_view text){
+    arenaReserve(arena, text.size());
+    memcpy(arena.next, text.data(), text.size());
+    string_view copy(arena.next, text.size());
+    arena.next += text.size();
+    arena.left -= text.size();
+    return copy;
+}
+
+
+// storeStationValues
+//
+// Given inputStationsFile as a reference, stationInfo struct stations array, number of stations, and the textArena the
+// station text goes into, the program inputs data into stationInfo struct stations array and stores in appropraite
+// locations line by line. The ID and name are read into the same two buffers every line and copied into the arena, so
+// no string is allocated per station. No return type.
+//
+void storeStationValues(ifstream& inputStationsFile, stationInfo stations[], int N, textArena& text){
+    PROFILE_SCOPE(PROF_STORE_STATIONS);
+    string stationID, name;
+    for (int i = 0; i < N; ++i){
+        inputStationsFile >> stationID;
+        inputStationsFile >> stations[i].capacity;
+        inputStationsFile >> stations[i].latitude;
+        inputStationsFile >> stations[i].longitude;
+        
+        getline(inputStationsFile, name);
+        name.erase(0,1); // removes the extra space at index 0
+        stations[i].stationID = arenaCopy(text, stationID);
+        stations[i].name = arenaCopy(text, name);
+        
+    }
+    PROFILE_COUNT(PROF_ROWS_PARSED, N);
+}
+
+
+//
+// internStation
+//
+// Given the station dictionary by reference and a station ID, returns the dense index for the ID, adding it to the
+// dictionary if it hasn't been seen before.
+//
+int internStation(stationDictionary& dictionary, string_view stationID){
+    auto found = dictionary.indexOf.find(stationID);
+    if (found != dictionary.indexOf.end()){
+        return found->second;
+    }
+    
+    int index = dictionary.ids.size();
+    dictionary.ids.push_back(arenaCopy(dictionary.text, stationID));
+    dictionary.indexOf.emplace(dictionary.ids.back(), index);
+    return index;
+}
+
+
+//
+// buildStationDictionary
+//
+// Given stationInfo struct stations array, number of stations, and the station dictionary by reference, interns every
+// station ID in load order and stores the resulting index in the stations array. No return type.
+//
+void buildStationDictionary(stationInfo stations[], int S, stationDictionary& dictionary){
+    size_t idBytes = 0;
+    for (int i = 0; i < S; ++i){
+        idBytes += stations[i].stationID.size();
+    }
+    arenaReserve(dictionary.text, idBytes); // so the station file's IDs all land in one block
+    dictionary.indexOf.reserve(S);
+    for (int i = 0; i < S; ++i){
+        stations[i].index = internStation(dictionary, stations[i].stationID);
+    }
+}
+
+
+//
+// mapInputFileFrom
+//
+// Given a file name, the byte to start at by reference, and a mappedFile by reference, the program maps the file from that
+// byte to its end read-only into memory, from the page the byte is on, so the bytes before it are never mapped. A start
+// past the end of the file (the file was replaced by a shorter one) is set back to 0. If the file cannot be mapped (empty
+// file, pipe, etc.) it falls back to reading the bytes into a heap buffer. Returns false if the file cannot be opened.
+//
+bool mapInputFileFrom(const string& fileName, size_t& from, mappedFile& file){
+    file.data = nullptr;
+    file.size = 0;
+    file.isMapped = false;
+    file.mapOffset = 0;
+    
+    int fd = open(fileName.c_str(), O_RDONLY);
+    if (fd < 0){
+        return false;
+    }
+    
+    struct stat fileStat;
+    bool regular = fstat(fd, &fileStat) == 0 && S_ISREG(fileStat.st_mode);
+    if (regular){
+        size_t fileSize = fileStat.st_size;
+        if (from > fileSize){
+            from = 0;
+        }
+        size_t mapFrom = from - from % sysconf(_SC_PAGESIZE);
+        if (fileSize > from){
+            void* mapping = mmap(nullptr, fileSize - mapFrom, PROT_READ, MAP_PRIVATE, fd, mapFrom);
+            if (mapping != MAP_FAILED){
+                madvise(mapping, fileSize - mapFrom, MADV_SEQUENTIAL);
+                file.data = static_cast<const char*>(mapping) + (from - mapFrom);
+                file.size = fileSize - from;
+                file.isMapped = true;
+                file.mapOffset = from - mapFrom;
+                close(fd);
+                return true;
+            }
+        }
+        lseek(fd, from, SEEK_SET);
+    }
+    
+    // fallback: read the bytes into one heap buffer (from a pipe, everything, then the ones before from are dropped)
+    string contents;
+    char buffer[65536];
+    ssize_t bytesRead;
+    while ((bytesRead = read(fd, buffer, sizeof(buffer))) > 0){
+        contents.append(buffer, bytesRead);
+    }
+    close(fd);
+    if (!regular){
+        if (from > contents.size()){
+            from = 0;
+        }
+        contents.erase(0, from);
+    }
+    
+    char* copy = new char[contents.size() + 1];
+    memcpy(copy, contents.data(), contents.size());
+    file.data = copy;
+    file.size = contents.size();
+    return true;
+}
+
+
+//
+// mapInputFile
+//
+// Given a file name and a mappedFile by reference, the program maps the whole file read-only into memory (see
+// mapInputFileFrom). Returns false if the file cannot be opened.
+//
+bool mapInputFile(const string& fileName, mappedFile& file){
+    size_t from = 0;
+    return mapInputFileFrom(fileName, from, file);
+}
+
+
+//
+// unmapInputFile
+//
+// Given a mappedFile by reference, releases the mapping (or heap buffer) made by mapInputFileFrom. No return type.
+//
+void unmapInputFile(mappedFile& file){
+    if (file.isMapped){
+        munmap(const_cast<char*>(file.data - file.mapOffset), file.size + file.mapOffset);
+    } else {
+        delete[] file.data;
+    }
+    file.data = nullptr;
+    file.size = 0;
+}
+
+
+// unmaps a mappedFile when it goes out of scope, unless file is set to nullptr first (the mapping is kept)
+struct mappingGuard{
+    mappedFile* file;
+    ~mappingGuard(){
+        if (file != nullptr){
+            unmapInputFile(*file);
+        }
+    }
 };
+
+
+//
+// parseInt
+//
+// Given a token and an int by reference, parses an optionally signed decimal integer that spans the whole token.
+// Returns false (leaving value at 0) if the token is not a number or doesn't fit in an int.
+//
+bool parseInt(string_view token, int& value){
+    value = 0;
+    size_t i = 0;
+    bool negative = false;
+    
+    if (i < token.size() && (token[i] == '-' || token[i] == '+')){
+        negative = (token[i] == '-');
+        ++i;
+    }
+    if (i == token.size()){
+        return false;
+    }
+    
+    long long limit = negative ? -(long long)INT_MIN : INT_MAX;
+    long long result = 0;
+    for (; i < token.size(); ++i){
+        unsigned digit = (unsigned char)token[i] - '0';
+        if (digit > 9){
+            return false;
+        }
+        result = (result * 10) + digit;
+        if (result > limit){ // stop before a long run of digits can overflow
+            return false;
+        }
+    }
     
+    value = negative ? (int)-result : (int)result;
+    return true;
+}
+
+
+//
+// parseClockSeconds
+//
+// Given a "H:MM" or "H:MM:SS" token, returns the number of seconds after midnight, or -1 if the token is not a valid time
+// of day.
+//
+int parseClockSeconds(string_view token){
+    size_t colonIndex = token.find(':');
+    if (colonIndex == string_view::npos){
+        return -1;
+    }
+    
+    string_view minutePart = token.substr(colonIndex + 1);
+    string_view secondPart;
+    size_t secondColon = minutePart.find(':');
+    if (secondColon != string_view::npos){
+        secondPart = minutePart.substr(secondColon + 1);
+        minutePart = minutePart.substr(0, secondColon);
+    }
+    
+    int hour, min, sec = 0;
+    if (!parseInt(token.substr(0, colonIndex), hour) || !parseInt(minutePart, min)){
+        return -1;
+    }
+    if (secondColon != string_view::npos && !parseInt(secondPart, sec)){
+        return -1;
+    }
+    if (hour < 0 || hour > 23 || min < 0 || min > 59 || sec < 0 || sec > 59){
+        return -1;
+    }
+    
+    return (3600 * hour) + (60 * min) + sec;
+}
+
+
+//
+// daysFromCivil
+//
+// Given a year, month (1-12) and day of the month, returns the number of days since 1970-01-01 in the proleptic Gregorian
+// calendar (Howard Hinnant's days_from_civil).
+//
+int daysFromCivil(int year, int month, int day){
+    year -= (month <= 2);
+    int era = (year >= 0 ? year : year - 399) / 400;
+    int yearOfEra = year - era * 400;
+    int dayOfYear = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+    int dayOfEra = yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100 + dayOfYear;
+    return era * 146097 + dayOfEra - 719468;
+}
+
+
+//
+// parseDate
+//
+// Given a date token, "YYYY-MM-DD" or Divvy's older "M/D/YYYY", and the day by reference, sets day to the number of days
+// since 1970-01-01. Returns false if the token isn't a valid date from 1970 on.
+//
+bool parseDate(string_view token, int& day){
+    int year, month, dayOfMonth;
+    size_t first, second;
+    if ((first = token.find('-')) != string_view::npos && (second = token.find('-', first + 1)) != string_view::npos){
+        if (!parseInt(token.substr(0, first), year) || !parseInt(token.substr(first + 1, second - first - 1), month) ||
+            !parseInt(token.substr(second + 1), dayOfMonth)){
+            return false;
+        }
+    } else if ((first = token.find('/')) != string_view::npos && (second = token.find('/', first + 1)) != string_view::npos){
+        if (!parseInt(token.substr(0, first), month) || !parseInt(token.substr(first + 1, second - first - 1), dayOfMonth) ||
+            !parseInt(token.substr(second + 1), year)){
+            return false;
+        }
+    } else {
+        return false;
+    }
+    
+    static const int daysInMonth[12] = {31, 29, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+    if (year < 1970 || year > 9999 || month < 1 || month > 12 || dayOfMonth < 1 || dayOfMonth > daysInMonth[month - 1]){
+        return false;
+    }
+    bool leapYear = (year % 4 == 0 && year % 100 != 0) || year % 400 == 0;
+    if (month == 2 && dayOfMonth == 29 && !leapYear){
+        return false;
+    }
+    
+    day = daysFromCivil(year, month, dayOfMonth);
+    return true;
+}
+
+
+//
+// parseTripStart
+//
+// Given a trip's start time as a date token and a time token ("2021-03-09" "8:22:15"), one ISO token
+// ("2021-03-09T08:22:15", with date empty) or a time of day alone ("8:22", with date empty), and the minutes and epoch by
+// reference, sets mins to the minutes after midnight (-1 if the time is invalid) and epoch to the seconds since
+// 1970-01-01 (-1 if there is no valid date and time). No return type.
+//
+void parseTripStart(string_view date, string_view clock, short& mins, int64_t& epoch){
+    size_t isoSeparator = clock.find('T');
+    if (date.empty() && isoSeparator != string_view::npos){
+        date = clock.substr(0, isoSeparator);
+        clock = clock.substr(isoSeparator + 1);
+    }
+    
+    int seconds = parseClockSeconds(clock);
+    mins = (seconds < 0) ? -1 : seconds / 60;
+    
+    int day;
+    if (seconds < 0 || date.empty() || !parseDate(date, day)){
+        epoch = -1;
+        if (!date.empty()){ // a date that doesn't parse makes the whole timestamp invalid
+            mins = -1;
+        }
+        return;
+    }
+    epoch = (int64_t)day * 86400 + seconds;
+}
+
+
+//
+// splitLine
+//
+// Given the file bytes, a position by reference, the end of the range, and a tokens array of size maxTokens, splits the
+// line starting at pos into whitespace-separated tokens (views into the bytes) and moves pos to the start of the next
+// line. Returns the number of tokens on the line; extra tokens past maxTokens are counted but not stored.
+//
+int splitLine(const char* data, size_t& pos, size_t end, string_view tokens[], int maxTokens){
+    int numTokens = 0;
+    
+    while (pos < end && data[pos] != '\n'){
+        if (data[pos] == ' ' || data[pos] == '\t' || data[pos] == '\r'){
+            ++pos;
+            continue;
+        }
+        size_t start = pos;
+        while (pos < end && data[pos] != ' ' && data[pos] != '\n' && data[pos] != '\t' && data[pos] != '\r'){
+            ++pos;
+        }
+        if (numTokens < maxTokens){
+            tokens[numTokens] = string_view(data + start, pos - start);
+        }
+        numTokens++;
+    }
+    
+    if (pos < end){ // step over the newline
+        ++pos;
+    }
+    return numTokens;
+}
+
+
+// one worker's share of the bike trips file: the byte range [begin, end) starts and ends on line boundaries. Station IDs
+// missing from the station dictionary are collected in newStationIDs (first-seen order) and the chunk's rows refer to
+// the k-th one as -1 - k until the chunks are merged
+struct tripChunk{
+    size_t begin;
+    size_t end;
+    tripColumns trips;
+    vector<string_view> newStationIDs;
+};
+
+
+//
+// parseTripChunk
+//
+// Given the mapped bike trips file, the station dictionary (only read, so workers can share it), and a tripChunk by
+// reference, the program parses every line of the chunk's byte range into the chunk's own trip columns. The start time is
+// either a time of day or a date and a time (7 fields on the line, see parseTripStart). Blank lines, lines that don't
+// have the trip fields and lines whose duration isn't a number that fits in an int are skipped. No return type.
+//
+void parseTripChunk(const mappedFile& file, const stationDictionary& dictionary, tripChunk& chunk){
+    tripColumns& trips = chunk.trips;
+    unordered_map<string_view, int> newStations; // ID -> local (negative) index
+    
+    // rows are about 40 bytes, so this reserves roughly the right amount up front
+    size_t expectedRows = (chunk.end - chunk.begin) / 32 + 1;
+    trips.duration.reserve(expectedRows);
+    trips.startMins.reserve(expectedRows);
+    trips.startEpoch.reserve(expectedRows);
+    trips.startStation.reserve(expectedRows);
+    trips.endStation.reserve(expectedRows);
+    trips.tripID.reserve(expectedRows);
+    trips.bikeID.reserve(expectedRows);
+    trips.startTime.reserve(expectedRows);
+    
+    auto lookupStation = [&](string_view stationID){
+        auto found = dictionary.indexOf.find(stationID);
+        if (found != dictionary.indexOf.end()){
+            return found->second;
+        }
+        auto local = newStations.find(stationID);
+        if (local != newStations.end()){
+            return local->second;
+        }
+        int localIndex = -1 - (int)chunk.newStationIDs.size();
+        chunk.newStationIDs.push_back(stationID);
+        newStations.emplace(stationID, localIndex);
+        return localIndex;
+    };
+    
+    string_view fields[7];
+    size_t pos = chunk.begin;
+    while (pos < chunk.end){
+        int numFields = splitLine(file.data, pos, chunk.end, fields, 7);
+        if (numFields != 6 && numFields != 7){
+            continue;
+        }
+        
+        int duration;
+        if (!parseInt(fields[4], duration)){ // not a number, or too long to be one
+            continue;
+        }
+        
+        trips.tripID.push_back(fields[0]);
+        trips.bikeID.push_back(fields[1]);
+        trips.startStation.push_back(lookupStation(fields[2]));
+        trips.endStation.push_back(lookupStation(fields[3]));
+        trips.duration.push_back(duration);
+        
+        short mins;
+        int64_t epoch;
+        if (numFields == 7){ // date and time
+            parseTripStart(fields[5], fields[6], mins, epoch);
+            trips.startTime.push_back(string_view(fields[5].data(), fields[6].data() + fields[6].size() - fields[5].data()));
+        } else {
+            parseTripStart(string_view(), fields[5], mins, epoch);
+            trips.startTime.push_back(fields[5]);
+        }
+        trips.startMins.push_back(mins);
+        trips.startEpoch.push_back(epoch);
+    }
+}
+
+
+//
+// copyChunkInto
+//
+// Given a parsed tripChunk, the merged tripColumns struct trips by reference, the row the chunk starts at, and the global
+// station index of each of the chunk's new station IDs, copies the chunk's rows into place and replaces the chunk-local
+// station indices with global ones. Chunks write disjoint rows, so they can be copied in parallel. No return type.
+//
+void copyChunkInto(const tripChunk& chunk, tripColumns& trips, size_t firstRow, const vector<int>& newStationIndex){
+    const tripColumns& from = chunk.trips;
+    size_t rows = from.duration.size();
+    
+    copy(from.duration.begin(), from.duration.end(), trips.duration.ownedData() + firstRow);
+    copy(from.startMins.begin(), from.startMins.end(), trips.startMins.ownedData() + firstRow);
+    copy(from.startEpoch.begin(), from.startEpoch.end(), trips.startEpoch.ownedData() + firstRow);
+    
+    string_view* tripID = trips.tripID.ownedData() + firstRow;
+    string_view* bikeID = trips.bikeID.ownedData() + firstRow;
+    string_view* startTime = trips.startTime.ownedData() + firstRow;
+    int* startStations = trips.startStation.ownedData() + firstRow;
+    int* endStations = trips.endStation.ownedData() + firstRow;
+    for (size_t k = 0; k < rows; ++k){
+        tripID[k] = from.tripID[k];
+        bikeID[k] = from.bikeID[k];
+        startTime[k] = from.startTime[k];
+        int startStation = from.startStation[k];
+        int endStation = from.endStation[k];
+        startStations[k] = (startStation < 0) ? newStationIndex[-1 - startStation] : startStation;
+        endStations[k] = (endStation < 0) ? newStationIndex[-1 - endStation] : endStation;
+    }
+}
+
+
+//
+// storeBikeTripValues
+//
+// Given the mapped bike trips file as a reference, tripColumns struct trips, the station dictionary, a number of threads,
+// and a list of station IDs to intern later (nullptr to intern them right away), the program splits the file at newline
+// boundaries into one chunk per thread and parses the chunks in parallel (see parseTripChunk). New station IDs are then
+// interned chunk by chunk, so indices come out in file order, and the chunks are copied into the trip columns in file
+// order. With a list, the dictionary is only read: each new ID goes on the list once and gets the index interning the
+// list in order will give it. A leading record-count line is optional and is skipped if present; the number of trips is
+// whatever the file actually contains. Returns the number of trips.
+//
+int storeBikeTripValues(mappedFile& inputBikeTripsFile, tripColumns& trips, stationDictionary& dictionary, int numThreads, vector<string_view>* newStationIDs){
+    PROFILE_SCOPE(PROF_STORE_TRIPS);
+    const char* data = inputBikeTripsFile.data;
+    size_t size = inputBikeTripsFile.size;
+    
+    // skip the record-count line if the file starts with one
+    size_t start = 0;
+    string_view firstLine[2];
+    int count;
+    size_t afterFirstLine = 0;
+    if (splitLine(data, afterFirstLine, size, firstLine, 2) == 1 && parseInt(firstLine[0], count)){
+        start = afterFirstLine;
+    }
+    
+    // no point in threads for small files; give each chunk at least 1 MB
+    size_t maxChunks = (size - start) / (1 << 20) + 1;
+    int numChunks = (int)min((size_t)max(numThreads, 1), maxChunks);
+    
+    vector<tripChunk> chunks(numChunks);
+    size_t chunkStart = start;
+    for (int c = 0; c < numChunks; ++c){
+        size_t chunkEnd = (c == numChunks - 1) ? size : start + ((size - start) * (c + 1)) / numChunks;
+        while (chunkEnd < size && chunkEnd > 0 && data[chunkEnd - 1] != '\n'){ // move the cut to just after a newline
+            ++chunkEnd;
+        }
+        chunkEnd = max(chunkEnd, chunkStart);
+        chunks[c].begin = chunkStart;
+        chunks[c].end = chunkEnd;
+        chunkStart = chunkEnd;
+    }
+    
+    // (1) parse every chunk on its own thread
+    vector<thread> workers;
+    for (int c = 1; c < numChunks; ++c){
+        workers.emplace_back(parseTripChunk, cref(inputBikeTripsFile), cref(dictionary), ref(chunks[c]));
+    }
+    parseTripChunk(inputBikeTripsFile, dictionary, chunks[0]);
+    for (thread& worker : workers){
+        worker.join();
+    }
+    workers.clear();
+    
+    // (2) intern new station IDs in file order and work out where each chunk's rows go
+    vector<vector<int>> newStationIndex(numChunks);
+    vector<size_t> firstRow(numChunks + 1, 0);
+    unordered_map<string_view, int> listed; // new ID -> index, when they go on the list
+    for (int c = 0; c < numChunks; ++c){
+        for (string_view stationID : chunks[c].newStationIDs){
+            if (newStationIDs == nullptr){
+                newStationIndex[c].push_back(internStation(dictionary, stationID));
+                continue;
+            }
+            auto found = listed.try_emplace(stationID, (int)(dictionary.ids.size() + newStationIDs->size()));
+            if (found.second){
+                newStationIDs->push_back(stationID);
+            }
+            newStationIndex[c].push_back(found.first->second);
+        }
+        firstRow[c + 1] = firstRow[c] + chunks[c].trips.duration.size();
+    }
+    
+    // (3) copy the chunks into the final columns, in parallel since they don't overlap
+    size_t N = firstRow[numChunks];
+    trips.duration.resize(N);
+    trips.startMins.resize(N);
+    trips.startEpoch.resize(N);
+    trips.startStation.resize(N);
+    trips.endStation.resize(N);
+    trips.tripID.resize(N);
+    trips.bikeID.resize(N);
+    trips.startTime.resize(N);
+    
+    for (int c = 1; c < numChunks; ++c){
+        workers.emplace_back(copyChunkInto, cref(chunks[c]), ref(trips), firstRow[c], cref(newStationIndex[c]));
+    }
+    copyChunkInto(chunks[0], trips, firstRow[0], newStationIndex[0]);
+    for (thread& worker : workers){
+        worker.join();
+    }
+    
+    PROFILE_COUNT(PROF_ROWS_PARSED, N);
+    PROFILE_COUNT(PROF_BYTES_READ, size);
+    return N;
+}
+
+
+//
+// loadReport
+//
+// Given the number of rows and bytes loaded, the elapsed time in seconds, whether the file was memory-mapped, and the number
+// of loader threads, outputs the load throughput (rows/sec and MB/sec) to cerr so it doesn't mix with command output.
+// No return type.
+//
+void loadReport(int rows, size_t bytes, double seconds, bool isMapped, int numThreads){
+    double rowsPerSec = (seconds > 0.0) ? rows / seconds : 0.0;
+    double mbPerSec = (seconds > 0.0) ? (bytes / (1024.0 * 1024.0)) / seconds : 0.0;
+    
+    cerr << " loaded " << rows << " trips (" << bytes << " bytes) in " << seconds << " s: ";
+    cerr << (long long)rowsPerSec << " rows/sec, " << mbPerSec << " MB/sec (" << (isMapped ? "mmap" : "read");
+    cerr << ", " << numThreads << " threads)" << endl;
+}
+
+
+//
+// snapshot format
+//
+// A snapshot is the loaded dataset written out as raw arrays so it can be mapped back in without parsing. It starts with
+// a snapshotHeader, followed by the sections listed in snapshotSectionID, each starting on a 64-byte boundary. Numbers are
+// stored in the machine's native byte order (the header's byteOrder field catches a mismatch). Text is kept in one string
+// pool; every text column has an offsets array where string i is pool[offsets[i] .. offsets[i+1]). The indexes built
+// over the data (see datasetIndexes) follow, so a load doesn't build them again. Every section has a checksum that is
+// verified on load.
+//
+const char SNAPSHOT_MAGIC[8] = {'D', 'I', 'V', 'V', 'Y', 'S', 'N', 'P'};
+const uint32_t SNAPSHOT_VERSION = 3; // 2 added SNAP_TRIP_START_EPOCH, 3 the index sections
+const uint32_t SNAPSHOT_BYTE_ORDER = 0x01020304;
+
+enum snapshotSectionID{
+    SNAP_STATION_CAPACITY,      // int32[S]
+    SNAP_STATION_LATITUDE,      // double[S]
+    SNAP_STATION_LONGITUDE,     // double[S]
+    SNAP_STATION_INDEX,         // int32[S]
+    SNAP_STATION_ID_OFFSETS,    // uint64[S+1]
+    SNAP_STATION_NAME_OFFSETS,  // uint64[S+1]
+    SNAP_DICTIONARY_OFFSETS,    // uint64[D+1], station dictionary IDs in index order
+    SNAP_TRIP_DURATION,         // int32[T]
+    SNAP_TRIP_START_MINS,       // int16[T]
+    SNAP_TRIP_START_EPOCH,      // int64[T]
+    SNAP_TRIP_START_STATION,    // int32[T]
+    SNAP_TRIP_END_STATION,      // int32[T]
+    SNAP_TRIP_ID_OFFSETS,       // uint64[T+1]
+    SNAP_BIKE_ID_OFFSETS,       // uint64[T+1]
+    SNAP_START_TIME_OFFSETS,    // uint64[T+1]
+    SNAP_STRING_POOL,           // bytes
+    SNAP_NAME_ORDER,            // int32[S], station positions in name order
+    SNAP_NAME_GRAM_KEYS,        // uint32[G]
+    SNAP_NAME_GRAM_OFFSETS,     // int32[G+1]
+    SNAP_NAME_GRAM_RANKS,       // int32[N]
+    SNAP_PARTITIONS,            // int64[5P], each partition's day, begin, end, minStart, maxStart
+    SNAP_STATION_TRIPS,         // int32[D]
+    SNAP_MINUTE_TRIPS_BEFORE,   // int64[1441]
+    SNAP_MINUTE_SECONDS_BEFORE, // int64[1441]
+    SNAP_MINUTE_OFFSETS,        // int32[1441]
+    SNAP_MINUTE_STATIONS,       // int32[M]
+    SNAP_ROUTE_OFFSETS,         // int32[D+1]
+    SNAP_ROUTE_START,           // int32[R]
+    SNAP_ROUTE_END,             // int32[R]
+    SNAP_ROUTE_TRIPS,           // int32[R]
+    SNAP_ROUTE_MINUTE_OFFSETS,  // int32[1441]
+    SNAP_ROUTES_BY_MINUTE,      // int32[RM]
+    SNAP_BIKE_OFFSETS,          // int32[B+1]
+    SNAP_BIKE_TRIPS,            // int32[T]
+    SNAP_BIKE_RIDE_SECONDS,     // int64[B]
+    SNAP_BIKE_LONGEST_IDLE,     // int32[B]
+    SNAP_BIKE_FIRST_START,      // int64[B]
+    SNAP_BIKE_LAST_FINISH,      // int64[B]
+    SNAP_BIKE_LAST_ROW,         // int32[B]
+    SNAP_BIKE_LAST_END,         // int32[B]
+    SNAP_NUM_SECTIONS
+};
+
+struct snapshotSection{
+    uint64_t offset;
+    uint64_t bytes;
+    uint64_t checksum;
+};
+
+struct snapshotHeader{
+    char magic[8];
+    uint32_t version;
+    uint32_t byteOrder;
+    uint64_t numStations;
+    uint64_t numStationIDs;
+    uint64_t numTrips;
+    uint64_t numGrams;
+    uint64_t numGramRanks;
+    uint64_t numPartitions;
+    uint64_t numMinuteStations;
+    uint64_t numRoutes;
+    uint64_t numRoutesByMinute;
+    uint64_t numBikes;
+    uint64_t numSections;
+    snapshotSection sections[SNAP_NUM_SECTIONS];
+};
+
+
+// running checksum over a byte stream, computed 8 bytes at a time (Fletcher-style sums over 64-bit words).
+// pending holds the bytes of a word that isn't complete yet
+struct checksum64{
+    uint64_t sum;
+    uint64_t sumOfSums;
+    uint64_t totalBytes;
+    unsigned char pending[8];
+    int numPending;
+};
+
+
+//
+// checksumStart
+//
+// Given a checksum64 by reference, resets it. No return type.
+//
+void checksumStart(checksum64& checksum){
+    checksum.sum = 0;
+    checksum.sumOfSums = 0;
+    checksum.totalBytes = 0;
+    checksum.numPending = 0;
+}
+
+
+//
+// checksumUpdate
+//
+// Given a checksum64 by reference and some bytes, adds the bytes to the checksum. No return type.
+//
+void checksumUpdate(checksum64& checksum, const void* data, size_t bytes){
+    const unsigned char* p = static_cast<const unsigned char*>(data);
+    checksum.totalBytes += bytes;
+    
+    // finish a partial word first
+    while (bytes > 0 && checksum.numPending > 0){
+        checksum.pending[checksum.numPending++] = *p++;
+        bytes--;
+        if (checksum.numPending == 8){
+            uint64_t word;
+            memcpy(&word, checksum.pending, 8);
+            checksum.sum += word;
+            checksum.sumOfSums += checksum.sum;
+            checksum.numPending = 0;
+        }
+    }
+    
+    uint64_t sum = checksum.sum;
+    uint64_t sumOfSums = checksum.sumOfSums;
+    for (; bytes >= 8; bytes -= 8, p += 8){
+        uint64_t word;
+        memcpy(&word, p, 8);
+        sum += word;
+        sumOfSums += sum;
+    }
+    checksum.sum = sum;
+    checksum.sumOfSums = sumOfSums;
+    
+    while (bytes > 0){
+        checksum.pending[checksum.numPending++] = *p++;
+        bytes--;
+    }
+}
+
+
+//
+// checksumFinish
+//
+// Given a checksum64 by reference, folds in any partial word and the total length and returns the checksum.
+//
+uint64_t checksumFinish(checksum64& checksum){
+    if (checksum.numPending > 0){
+        uint64_t word = 0;
+        memcpy(&word, checksum.pending, checksum.numPending);
+        checksum.sum += word;
+        checksum.sumOfSums += checksum.sum;
+        checksum.numPending = 0;
+    }
+    return checksum.sum ^ (checksum.sumOfSums * 0x9E3779B97F4A7C15ULL) ^ checksum.totalBytes;
+}
+
+
+//
+// writeSnapshotBytes
+//
+// Given the snapshot output file, the checksum of the section being written, and some bytes, writes the bytes and adds
+// them to the checksum. No return type.
+//
+void writeSnapshotBytes(ofstream& out, checksum64& checksum, const void* data, size_t bytes){
+    out.write(static_cast<const char*>(data), bytes);
+    checksumUpdate(checksum, data, bytes);
+}
+
+
+//
+// writeStringOffsets
+//
+// Given the snapshot output file, the section checksum, a list of strings, and the pool offset by reference, writes the
+// offsets array for the strings (where each one will sit in the string pool) and moves the pool offset past them.
+// No return type.
+//
+template <typename StringList>
+void writeStringOffsets(ofstream& out, checksum64& checksum, const StringList& strings, uint64_t& poolOffset){
+    vector<uint64_t> offsets;
+    offsets.reserve(strings.size() + 1);
+    for (size_t i = 0; i < strings.size(); ++i){
+        offsets.push_back(poolOffset);
+        poolOffset += strings[i].size();
+    }
+    offsets.push_back(poolOffset);
+    writeSnapshotBytes(out, checksum, offsets.data(), offsets.size() * sizeof(uint64_t));
+}
+
+
+//
+// writeStringPool
+//
+// Given the snapshot output file, the section checksum, and a list of strings, appends the strings' bytes to the string
+// pool in order. No return type.
+//
+template <typename StringList>
+void writeStringPool(ofstream& out, checksum64& checksum, const StringList& strings){
+    for (size_t i = 0; i < strings.size(); ++i){
+        writeSnapshotBytes(out, checksum, strings[i].data(), strings[i].size());
+    }
+}
+
+
+//
+// saveSnapshot
+//
+// Given a file name, stationInfo struct stations array, total number of stations(S), the station dictionary, tripColumns
+// struct trips, total number of trips(T), and the datasetIndexes built over all T trips (as they are before any append),
+// writes the dataset and its indexes as a snapshot (see snapshot format). The header is written last, once every
+// section's position and checksum are known. Returns false if the file can't be written.
+//
+bool saveSnapshot(const string& fileName, const stationInfo stations[], int S, const stationDictionary& dictionary, const tripColumns& trips, int T, const datasetIndexes& indexes){
+    ofstream out(fileName, ios::binary | ios::trunc);
+    if (!out.good()){
+        return false;
+    }
+    
+    const routeMatrix& routes = indexes.routes;
+    const bikeTimeline& bikes = indexes.bikes;
+    snapshotHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+    header.version = SNAPSHOT_VERSION;
+    header.byteOrder = SNAPSHOT_BYTE_ORDER;
+    header.numStations = S;
+    header.numStationIDs = dictionary.ids.size();
+    header.numTrips = T;
+    header.numGrams = indexes.names.gramKeys.size();
+    header.numGramRanks = indexes.names.gramRanks.size();
+    header.numPartitions = indexes.partitions.size();
+    header.numMinuteStations = indexes.tripTimes.minuteStations.size();
+    header.numRoutes = routes.routeEnd.size();
+    header.numRoutesByMinute = routes.routesByMinute.size();
+    header.numBikes = bikes.bikeIDs.size();
+    header.numSections = SNAP_NUM_SECTIONS;
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header)); // placeholder
+    
+    // station columns, pulled out of the stations array
+    vector<int32_t> capacity(S), stationIndex(S);
+    vector<double> latitude(S), longitude(S);
+    vector<string_view> stationIDs(S), names(S);
+    for (int i = 0; i < S; ++i){
+        capacity[i] = stations[i].capacity;
+        latitude[i] = stations[i].latitude;
+        longitude[i] = stations[i].longitude;
+        stationIndex[i] = stations[i].index;
+        stationIDs[i] = stations[i].stationID;
+        names[i] = stations[i].name;
+    }
+    vector<int64_t> partitions;
+    for (const tripPartition& partition : indexes.partitions){
+        partitions.insert(partitions.end(), {partition.day, partition.begin, partition.end, partition.minStart, partition.maxStart});
+    }
+    
+    // every section but the text ones is one array
+    const void* arrays[SNAP_NUM_SECTIONS] = {};
+    size_t arrayBytes[SNAP_NUM_SECTIONS] = {};
+    auto addArray = [&](int section, const auto* data, size_t count){
+        arrays[section] = data;
+        arrayBytes[section] = count * sizeof(*data);
+    };
+    addArray(SNAP_STATION_CAPACITY, capacity.data(), S);
+    addArray(SNAP_STATION_LATITUDE, latitude.data(), S);
+    addArray(SNAP_STATION_LONGITUDE, longitude.data(), S);
+    addArray(SNAP_STATION_INDEX, stationIndex.data(), S);
+    addArray(SNAP_TRIP_DURATION, trips.duration.data(), T);
+    addArray(SNAP_TRIP_START_MINS, trips.startMins.data(), T);
+    addArray(SNAP_TRIP_START_EPOCH, trips.startEpoch.data(), T);
+    addArray(SNAP_TRIP_START_STATION, trips.startStation.data(), T);
+    addArray(SNAP_TRIP_END_STATION, trips.endStation.data(), T);
+    addArray(SNAP_NAME_ORDER, indexes.nameOrder.data(), S);
+    addArray(SNAP_NAME_GRAM_KEYS, indexes.names.gramKeys.data(), header.numGrams);
+    addArray(SNAP_NAME_GRAM_OFFSETS, indexes.names.gramOffsets.data(), header.numGrams + 1);
+    addArray(SNAP_NAME_GRAM_RANKS, indexes.names.gramRanks.data(), header.numGramRanks);
+    addArray(SNAP_PARTITIONS, partitions.data(), partitions.size());
+    addArray(SNAP_STATION_TRIPS, indexes.stationTrips.trips.data(), header.numStationIDs);
+    addArray(SNAP_MINUTE_TRIPS_BEFORE, indexes.tripTimes.tripsBefore, 1441);
+    addArray(SNAP_MINUTE_SECONDS_BEFORE, indexes.tripTimes.secondsBefore, 1441);
+    addArray(SNAP_MINUTE_OFFSETS, indexes.tripTimes.minuteOffsets.data(), 1441);
+    addArray(SNAP_MINUTE_STATIONS, indexes.tripTimes.minuteStations.data(), header.numMinuteStations);
+    addArray(SNAP_ROUTE_OFFSETS, routes.routeOffsets.data(), header.numStationIDs + 1);
+    addArray(SNAP_ROUTE_START, routes.routeStart.data(), header.numRoutes);
+    addArray(SNAP_ROUTE_END, routes.routeEnd.data(), header.numRoutes);
+    addArray(SNAP_ROUTE_TRIPS, routes.routeTrips.data(), header.numRoutes);
+    addArray(SNAP_ROUTE_MINUTE_OFFSETS, routes.minuteOffsets.data(), 1441);
+    addArray(SNAP_ROUTES_BY_MINUTE, routes.routesByMinute.data(), header.numRoutesByMinute);
+    addArray(SNAP_BIKE_OFFSETS, bikes.bikeOffsets.data(), header.numBikes + 1);
+    addArray(SNAP_BIKE_TRIPS, bikes.bikeTrips.data(), T);
+    addArray(SNAP_BIKE_RIDE_SECONDS, bikes.rideSeconds.data(), header.numBikes);
+    addArray(SNAP_BIKE_LONGEST_IDLE, bikes.longestIdle.data(), header.numBikes);
+    addArray(SNAP_BIKE_FIRST_START, bikes.firstStart.data(), header.numBikes);
+    addArray(SNAP_BIKE_LAST_FINISH, bikes.lastFinish.data(), header.numBikes);
+    addArray(SNAP_BIKE_LAST_ROW, bikes.lastRow.data(), header.numBikes);
+    addArray(SNAP_BIKE_LAST_END, bikes.lastEnd.data(), header.numBikes);
+    
+    uint64_t poolOffset = 0;
+    for (int section = 0; section < SNAP_NUM_SECTIONS; ++section){
+        // pad to a 64-byte boundary
+        uint64_t position = out.tellp();
+        static const char padding[64] = {};
+        out.write(padding, (64 - position % 64) % 64);
+        
+        checksum64 checksum;
+        checksumStart(checksum);
+        header.sections[section].offset = out.tellp();
+        
+        switch (section){
+            case SNAP_STATION_ID_OFFSETS:
+                writeStringOffsets(out, checksum, stationIDs, poolOffset);
+                break;
+            case SNAP_STATION_NAME_OFFSETS:
+                writeStringOffsets(out, checksum, names, poolOffset);
+                break;
+            case SNAP_DICTIONARY_OFFSETS:
+                writeStringOffsets(out, checksum, dictionary.ids, poolOffset);
+                break;
+            case SNAP_TRIP_ID_OFFSETS:
+                writeStringOffsets(out, checksum, trips.tripID, poolOffset);
+                break;
+            case SNAP_BIKE_ID_OFFSETS:
+                writeStringOffsets(out, checksum, trips.bikeID, poolOffset);
+                break;
+            case SNAP_START_TIME_OFFSETS:
+                writeStringOffsets(out, checksum, trips.startTime, poolOffset);
+                break;
+            case SNAP_STRING_POOL: // same order as the offsets arrays above
+                writeStringPool(out, checksum, stationIDs);
+                writeStringPool(out, checksum, names);
+                writeStringPool(out, checksum, dictionary.ids);
+                writeStringPool(out, checksum, trips.tripID);
+                writeStringPool(out, checksum, trips.bikeID);
+                writeStringPool(out, checksum, trips.startTime);
+                break;
+            default:
+                writeSnapshotBytes(out, checksum, arrays[section], arrayBytes[section]);
+                break;
+        }
+        
+        header.sections[section].bytes = (uint64_t)out.tellp() - header.sections[section].offset;
+        header.sections[section].checksum = checksumFinish(checksum);
+    }
+    
+    out.seekp(0);
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out.close();
+    return !out.fail();
+}
+
+
+//
+// snapshotText
+//
+// Given the mapped snapshot, its header, an offsets section, and an item number, returns a view of string i of that
+// section in the string pool.
+//
+string_view snapshotText(const mappedFile& file, const snapshotHeader& header, const uint64_t offsets[], size_t i){
+    const char* pool = file.data + header.sections[SNAP_STRING_POOL].offset;
+    return string_view(pool + offsets[i], offsets[i + 1] - offsets[i]);
+}
+
+
+//
+// snapshotValuesInRange
+//
+// Given the mapped snapshot, its header, an int32 section, and a range [low, high), returns true if every value in the
+// section is inside the range.
+//
+bool snapshotValuesInRange(const mappedFile& file, const snapshotHeader& header, int section, int64_t low, int64_t high){
+    const int32_t* values = reinterpret_cast<const int32_t*>(file.data + header.sections[section].offset);
+    size_t count = header.sections[section].bytes / 4;
+    for (size_t i = 0; i < count; ++i){
+        if (values[i] < low || values[i] >= high){
+            return false;
+        }
+    }
+    return true;
+}
+
+
+//
+// snapshotOffsetsValid
+//
+// Given the mapped snapshot, its header, an int32 offsets section, the number of items they index, and whether a run may
+// be empty, returns true if the offsets start at 0, end at the number of items and never decrease (always increase if
+// runs can't be empty).
+//
+bool snapshotOffsetsValid(const mappedFile& file, const snapshotHeader& header, int section, uint64_t items, bool emptyRuns){
+    const int32_t* offsets = reinterpret_cast<const int32_t*>(file.data + header.sections[section].offset);
+    size_t count = header.sections[section].bytes / 4;
+    if (offsets[0] != 0 || (uint64_t)offsets[count - 1] != items){
+        return false;
+    }
+    for (size_t i = 1; i < count; ++i){
+        if (offsets[i] < offsets[i - 1] || (!emptyRuns && offsets[i] == offsets[i - 1])){
+            return false;
+        }
+    }
+    return true;
+}
+
+
+//
+// checkSnapshot
+//
+// Given the mapped snapshot and its header, checks the format version, that every section has the size the counts call
+// for and lies inside the file, that every section's checksum matches, that all string offsets stay inside the string
+// pool, and that every station, row, route, rank and offset the indexes hold is in range. Returns an error message, or
+// an empty string if the snapshot is good.
+//
+string checkSnapshot(const mappedFile& file, const snapshotHeader& header){
+    if (memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic)) != 0){
+        return "not a snapshot file";
+    }
+    if (header.version != SNAPSHOT_VERSION || header.byteOrder != SNAPSHOT_BYTE_ORDER || header.numSections != SNAP_NUM_SECTIONS){
+        return "unsupported snapshot version";
+    }
+    uint64_t counts[] = {header.numStations, header.numStationIDs, header.numTrips, header.numGrams, header.numGramRanks,
+                         header.numPartitions, header.numMinuteStations, header.numRoutes, header.numRoutesByMinute, header.numBikes};
+    for (uint64_t count : counts){
+        if (count > 0x7fffffff){
+            return "bad record counts";
+        }
+    }
+    
+    uint64_t S = header.numStations, D = header.numStationIDs, T = header.numTrips;
+    uint64_t G = header.numGrams, R = header.numRoutes, B = header.numBikes;
+    uint64_t expectedBytes[SNAP_NUM_SECTIONS] = {
+        S * 4, S * 8, S * 8, S * 4, (S + 1) * 8, (S + 1) * 8, (D + 1) * 8,
+        T * 4, T * 2, T * 8, T * 4, T * 4, (T + 1) * 8, (T + 1) * 8, (T + 1) * 8,
+        header.sections[SNAP_STRING_POOL].bytes,
+        S * 4, G * 4, (G + 1) * 4, header.numGramRanks * 4,
+        header.numPartitions * 40, D * 4,
+        1441 * 8, 1441 * 8, 1441 * 4, header.numMinuteStations * 4,
+        (D + 1) * 4, R * 4, R * 4, R * 4, 1441 * 4, header.numRoutesByMinute * 4,
+        (B + 1) * 4, T * 4, B * 8, B * 4, B * 8, B * 8, B * 4, B * 4
+    };
+    
+    for (int section = 0; section < SNAP_NUM_SECTIONS; ++section){
+        const snapshotSection& info = header.sections[section];
+        if (info.bytes != expectedBytes[section] || info.offset > file.size || info.bytes > file.size - info.offset || info.offset % 8 != 0){
+            return "section " + to_string(section) + " is truncated or the wrong size";
+        }
+        checksum64 checksum;
+        checksumStart(checksum);
+        checksumUpdate(checksum, file.data + info.offset, info.bytes);
+        if (checksumFinish(checksum) != info.checksum){
+            return "checksum mismatch in section " + to_string(section);
+        }
+    }
+    
+    // the offsets arrays are laid out back to back over the pool, so they must be non-decreasing and end inside it
+    uint64_t poolBytes = header.sections[SNAP_STRING_POOL].bytes;
+    int offsetSections[6] = {SNAP_STATION_ID_OFFSETS, SNAP_STATION_NAME_OFFSETS, SNAP_DICTIONARY_OFFSETS,
+                             SNAP_TRIP_ID_OFFSETS, SNAP_BIKE_ID_OFFSETS, SNAP_START_TIME_OFFSETS};
+    for (int section : offsetSections){
+        const uint64_t* offsets = reinterpret_cast<const uint64_t*>(file.data + header.sections[section].offset);
+        size_t count = header.sections[section].bytes / 8;
+        for (size_t i = 0; i < count; ++i){
+            if (offsets[i] > poolBytes || (i > 0 && offsets[i] < offsets[i - 1])){
+                return "bad string offsets in section " + to_string(section);
+            }
+        }
+    }
+    
+    // station references must point into the dictionary
+    if (!snapshotValuesInRange(file, header, SNAP_STATION_INDEX, 0, D)){
+        return "bad station index";
+    }
+    if (!snapshotValuesInRange(file, header, SNAP_TRIP_START_STATION, 0, D) || !snapshotValuesInRange(file, header, SNAP_TRIP_END_STATION, 0, D)){
+        return "bad trip station";
+    }
+    
+    // and the indexes' references into what they index
+    bool indexesGood = snapshotValuesInRange(file, header, SNAP_NAME_ORDER, 0, S)
+        && snapshotOffsetsValid(file, header, SNAP_NAME_GRAM_OFFSETS, header.numGramRanks, true)
+        && snapshotValuesInRange(file, header, SNAP_NAME_GRAM_RANKS, 0, S)
+        && snapshotOffsetsValid(file, header, SNAP_MINUTE_OFFSETS, header.numMinuteStations, true)
+        && snapshotValuesInRange(file, header, SNAP_MINUTE_STATIONS, 0, D)
+        && snapshotOffsetsValid(file, header, SNAP_ROUTE_OFFSETS, R, true)
+        && snapshotValuesInRange(file, header, SNAP_ROUTE_START, 0, D)
+        && snapshotValuesInRange(file, header, SNAP_ROUTE_END, 0, D)
+        && snapshotOffsetsValid(file, header, SNAP_ROUTE_MINUTE_OFFSETS, header.numRoutesByMinute, true)
+        && snapshotValuesInRange(file, header, SNAP_ROUTES_BY_MINUTE, 0, R)
+        && snapshotOffsetsValid(file, header, SNAP_BIKE_OFFSETS, T, false)
+        && snapshotValuesInRange(file, header, SNAP_BIKE_TRIPS, 0, T)
+        && snapshotValuesInRange(file, header, SNAP_BIKE_LAST_ROW, -1, T)
+        && snapshotValuesInRange(file, header, SNAP_BIKE_LAST_END, -1, D);
+    const int64_t* partitions = reinterpret_cast<const int64_t*>(file.data + header.sections[SNAP_PARTITIONS].offset);
+    for (uint64_t p = 0; p < header.numPartitions && indexesGood; ++p){
+        int64_t begin = partitions[p * 5 + 1], end = partitions[p * 5 + 2];
+        indexesGood = begin >= 0 && begin <= end && (uint64_t)end <= T;
+    }
+    if (!indexesGood){
+        return "bad index";
+    }
+    
+    return "";
+}
+
+
+//
+// groupBikesByLastEnd
+//
+// Given total # of station indices and a bikeTimeline by reference, fills lastAt from every bike's lastEnd, so each
+// station's list holds the bikes whose last trip ended there in bike index order. No return type.
+//
+void groupBikesByLastEnd(int numStationIDs, bikeTimeline& bikes){
+    bikes.lastAt.assign(numStationIDs, vector<int>());
+    for (int b = 0; b < (int)bikes.lastEnd.size(); ++b){
+        if (bikes.lastEnd[b] >= 0){
+            bikes.lastAt[bikes.lastEnd[b]].push_back(b);
+        }
+    }
+}
+
+
+//
+// loadSnapshot
+//
+// Given a snapshot file name, a mappedFile by reference (the snapshot stays mapped since the trip columns and indexes
+// point into it), the stations array and number of stations by reference, the station dictionary, tripColumns struct
+// trips, number of trips by reference, and the datasetIndexes, maps the snapshot, checks it (see checkSnapshot), and
+// fills in the dataset and its indexes. Nothing is parsed or built: the trip columns, the routes by minute and the bikes'
+// trips are borrowed from the mapping (see columnArray), the other indexes are copied, and only the bike ID lookup and
+// the bikes by last station are put back together, from the bikes' first trips and last stations. Returns an error
+// message, or an empty string on success.
+//
+string loadSnapshot(const string& fileName, mappedFile& file, stationInfo*& stations, int& S, stationDictionary& dictionary, tripColumns& trips, int& T, datasetIndexes& indexes){
+    PROFILE_SCOPE(PROF_LOAD_SNAPSHOT);
+    if (!mapInputFile(fileName, file)){
+        return "unable to open snapshot file '" + fileName + "'";
+    }
+    PROFILE_COUNT(PROF_BYTES_READ, file.size);
+    mappingGuard guard = {&file}; // unmaps the snapshot on every way out but the last
+    
+    snapshotHeader header;
+    if (file.size < sizeof(header)){
+        return "not a snapshot file";
+    }
+    memcpy(&header, file.data, sizeof(header));
+    string problem = checkSnapshot(file, header);
+    if (!problem.empty()){
+        return problem;
+    }
+    
+    auto section = [&](int id){
+        return file.data + header.sections[id].offset;
+    };
+    auto copySection = [&](auto& into, int id){
+        using Value = typename decay_t<decltype(into)>::value_type;
+        const Value* first = reinterpret_cast<const Value*>(section(id));
+        into.assign(first, first + header.sections[id].bytes / sizeof(Value));
+    };
+    auto borrowSection = [&](auto& into, int id){
+        using Value = decay_t<decltype(into[0])>;
+        into.borrow(reinterpret_cast<const Value*>(section(id)), header.sections[id].bytes / sizeof(Value));
+    };
+    
+    // stations
+    S = header.numStations;
+    stations = new stationInfo[S];
+    const int32_t* capacity = reinterpret_cast<const int32_t*>(section(SNAP_STATION_CAPACITY));
+    const double* latitude = reinterpret_cast<const double*>(section(SNAP_STATION_LATITUDE));
+    const double* longitude = reinterpret_cast<const double*>(section(SNAP_STATION_LONGITUDE));
+    const int32_t* stationIndex = reinterpret_cast<const int32_t*>(section(SNAP_STATION_INDEX));
+    const uint64_t* stationIDOffsets = reinterpret_cast<const uint64_t*>(section(SNAP_STATION_ID_OFFSETS));
+    const uint64_t* nameOffsets = reinterpret_cast<const uint64_t*>(section(SNAP_STATION_NAME_OFFSETS));
+    for (int i = 0; i < S; ++i){
+        stations[i].stationID = snapshotText(file, header, stationIDOffsets, i);
+        stations[i].capacity = capacity[i];
+        stations[i].latitude = latitude[i];
+        stations[i].longitude = longitude[i];
+        stations[i].name = snapshotText(file, header, nameOffsets, i);
+        stations[i].index = stationIndex[i];
+    }
+    
+    // station dictionary, in index order
+    const uint64_t* dictionaryOffsets = reinterpret_cast<const uint64_t*>(section(SNAP_DICTIONARY_OFFSETS));
+    int D = header.numStationIDs;
+    arenaReserve(dictionary.text, dictionaryOffsets[D] - dictionaryOffsets[0]);
+    dictionary.indexOf.reserve(D);
+    for (int k = 0; k < D; ++k){
+        internStation(dictionary, snapshotText(file, header, dictionaryOffsets, k));
+    }
+    
+    // trips, read in place
+    T = header.numTrips;
+    borrowSection(trips.duration, SNAP_TRIP_DURATION);
+    borrowSection(trips.startMins, SNAP_TRIP_START_MINS);
+    borrowSection(trips.startEpoch, SNAP_TRIP_START_EPOCH);
+    borrowSection(trips.startStation, SNAP_TRIP_START_STATION);
+    borrowSection(trips.endStation, SNAP_TRIP_END_STATION);
+    const char* pool = section(SNAP_STRING_POOL);
+    trips.tripID.borrow(pool, reinterpret_cast<const uint64_t*>(section(SNAP_TRIP_ID_OFFSETS)), T);
+    trips.bikeID.borrow(pool, reinterpret_cast<const uint64_t*>(section(SNAP_BIKE_ID_OFFSETS)), T);
+    trips.startTime.borrow(pool, reinterpret_cast<const uint64_t*>(section(SNAP_START_TIME_OFFSETS)), T);
+    
+    // station indexes
+    copySection(indexes.nameOrder, SNAP_NAME_ORDER);
+    copySection(indexes.names.gramKeys, SNAP_NAME_GRAM_KEYS);
+    copySection(indexes.names.gramOffsets, SNAP_NAME_GRAM_OFFSETS);
+    copySection(indexes.names.gramRanks, SNAP_NAME_GRAM_RANKS);
+    copySection(indexes.stationTrips.trips, SNAP_STATION_TRIPS);
+    indexes.stationTrips.countedTrips = T;
+    
+    // trip indexes
+    const int64_t* partitions = reinterpret_cast<const int64_t*>(section(SNAP_PARTITIONS));
+    indexes.partitions.resize(header.numPartitions);
+    for (size_t p = 0; p < indexes.partitions.size(); ++p){
+        const int64_t* fields = partitions + p * 5;
+        indexes.partitions[p] = {(int)fields[0], (int)fields[1], (int)fields[2], fields[3], fields[4]};
+    }
+    
+    timeIndex& tripTimes = indexes.tripTimes;
+    memcpy(tripTimes.tripsBefore, section(SNAP_MINUTE_TRIPS_BEFORE), sizeof(tripTimes.tripsBefore));
+    memcpy(tripTimes.secondsBefore, section(SNAP_MINUTE_SECONDS_BEFORE), sizeof(tripTimes.secondsBefore));
+    copySection(tripTimes.minuteOffsets, SNAP_MINUTE_OFFSETS);
+    copySection(tripTimes.minuteStations, SNAP_MINUTE_STATIONS);
+    
+    routeMatrix& routes = indexes.routes;
+    copySection(routes.routeOffsets, SNAP_ROUTE_OFFSETS);
+    copySection(routes.routeStart, SNAP_ROUTE_START);
+    copySection(routes.routeEnd, SNAP_ROUTE_END);
+    copySection(routes.routeTrips, SNAP_ROUTE_TRIPS);
+    copySection(routes.minuteOffsets, SNAP_ROUTE_MINUTE_OFFSETS);
+    borrowSection(routes.routesByMinute, SNAP_ROUTES_BY_MINUTE);
+    routes.addedRoutes.clear();
+    routes.addedFrom.clear();
+    routes.addedByMinute.clear();
+    routes.builtTrips = T;
+    routes.appendedTrips = 0;
+    
+    bikeTimeline& bikes = indexes.bikes;
+    copySection(bikes.bikeOffsets, SNAP_BIKE_OFFSETS);
+    borrowSection(bikes.bikeTrips, SNAP_BIKE_TRIPS);
+    copySection(bikes.rideSeconds, SNAP_BIKE_RIDE_SECONDS);
+    copySection(bikes.longestIdle, SNAP_BIKE_LONGEST_IDLE);
+    copySection(bikes.firstStart, SNAP_BIKE_FIRST_START);
+    copySection(bikes.lastFinish, SNAP_BIKE_LAST_FINISH);
+    copySection(bikes.lastRow, SNAP_BIKE_LAST_ROW);
+    copySection(bikes.lastEnd, SNAP_BIKE_LAST_END);
+    int numBikes = header.numBikes;
+    bikes.indexOf.clear();
+    bikes.indexOf.reserve(numBikes);
+    bikes.bikeIDs.resize(numBikes);
+    for (int b = 0; b < numBikes; ++b){
+        bikes.bikeIDs[b] = trips.bikeID[bikes.bikeTrips[bikes.bikeOffsets[b]]];
+        bikes.indexOf.emplace(bikes.bikeIDs[b], b);
+    }
+    bikes.addedTrips.assign(numBikes, vector<int>());
+    groupBikesByLastEnd(D, bikes);
+    
+    guard.file = nullptr; // the trip columns point into the mapping, so it stays
+    return "";
+}
+
+
+//
+// runOnWorkers
+//
+// Given a number of workers and a function of the worker number, runs the function for workers 1..numWorkers-1 on their
+// own threads and for worker 0 on this thread, and waits for all of them. No return type.
+//
+template <typename Work>
+void runOnWorkers(int numWorkers, const Work& work){
+    vector<thread> workers;
+    for (int w = 1; w < numWorkers; ++w){
+        workers.emplace_back(cref(work), w);
+    }
+    work(0);
+    for (thread& worker : workers){
+        worker.join();
+    }
+}
+
+
+const int SCAN_CHUNK_ROWS = 1 << 16; // rows per piece of work in a parallel scan
+
+
+// the chunks of a parallel scan still owned by one worker, [front, back) packed as front << 32 | back so the owner taking
+// chunks from the front and other workers stealing from the back settle every race with one compare-and-swap. Each worker's
+// range gets its own cache line
+struct alignas(64) chunkRange{
+    atomic<uint64_t> bounds;
+};
+
+
+//
+// takeChunk
+//
+// Given a worker's chunkRange, takes the chunk at its front. Returns the chunk, or -1 if the range is empty.
+//
+int takeChunk(chunkRange& range){
+    uint64_t bounds = range.bounds.load(memory_order_acquire);
+    while (true){
+        uint32_t front = bounds >> 32, back = (uint32_t)bounds;
+        if (front >= back){
+            return -1;
+        }
+        if (range.bounds.compare_exchange_weak(bounds, ((uint64_t)(front + 1) << 32) | back, memory_order_acq_rel)){
+            return front;
+        }
+    }
+}
+
+
+//
+// stealChunks
+//
+// Given the chunkRanges of all workers and the number of the worker that ran out of chunks, takes the back half of the
+// first other range that still has chunks and makes it the thief's own range. Returns false if every range is empty.
+// A chunk is only ever taken once, so a range that was seen with a chunk in it can't be seen with that chunk again and
+// the compare-and-swap can't be fooled by a range that emptied and refilled in between.
+//
+bool stealChunks(chunkRange ranges[], int numWorkers, int thief){
+    for (int k = 1; k < numWorkers; ++k){
+        chunkRange& victim = ranges[(thief + k) % numWorkers];
+        uint64_t bounds = victim.bounds.load(memory_order_acquire);
+        while (true){
+            uint32_t front = bounds >> 32, back = (uint32_t)bounds;
+            if (front >= back){
+                break;
+            }
+            uint32_t split = back - (back - front + 1) / 2;
+            if (victim.bounds.compare_exchange_weak(bounds, ((uint64_t)front << 32) | split, memory_order_acq_rel)){
+                ranges[thief].bounds.store(((uint64_t)split << 32) | back, memory_order_release);
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+
+// one parallel scan handed to the scanPool: run(worker) is called for workers 1..numWorkers-1 by whichever pool threads
+// are free (the scan's own thread is worker 0). claimed is how many workers have been handed out and running how many are
+// still in run; both change under the pool's lock
+struct scanJob{
+    function<void(int)> run;
+    int numWorkers;
+    int claimed;
+    int running;
+    condition_variable finished;
+};
+
+
+// threads kept for parallel scans, so a scan doesn't start and join threads of its own. Idle threads wait for a job with
+// workers left to hand out. A scan that finds every thread busy (say, several commands scanning at once) does more of the
+// work itself, since its workers steal whatever chunks nobody took. The threads are stopped and joined at exit
+struct scanPool{
+    mutex lock;
+    condition_variable wakeUp;
+    vector<scanJob*> jobs;
+    vector<thread> threads;
+    bool stopping = false;
+    
+    ~scanPool(){
+        {
+            lock_guard<mutex> guard(lock);
+            stopping = true;
+        }
+        wakeUp.notify_all();
+        for (thread& t : threads){
+            t.join();
+        }
+    }
+};
+
+
+//
+// scanPoolThread
+//
+// Given the scanPool, takes a worker of the newest job with workers left, runs it, and waits for the next one, until the
+// pool stops. No return type.
+//
+void scanPoolThread(scanPool& pool){
+    unique_lock<mutex> guard(pool.lock);
+    while (true){
+        pool.wakeUp.wait(guard, [&](){
+            return pool.stopping || !pool.jobs.empty();
+        });
+        if (pool.stopping){
+            return;
+        }
+        scanJob* job = pool.jobs.back();
+        int worker = job->claimed++;
+        if (job->claimed == job->numWorkers){
+            pool.jobs.pop_back();
+        }
+        job->running++;
+        
+        guard.unlock();
+        job->run(worker);
+        guard.lock();
+        
+        if (--job->running == 0){
+            job->finished.notify_all();
+        }
+    }
+}
+
+
+//
+// runOnScanPool
+//
+// Given a number of workers and a function of the worker number, runs worker 0 on this thread and offers workers
+// 1..numWorkers-1 to the scan pool's threads (starting threads the first time the pool is smaller than that). Once
+// worker 0 returns, the workers nobody took are withdrawn and the ones that started are waited for. The function has to
+// be able to finish the job with any subset of workers running, which parallelReduce's stealing does. No return type.
+//
+void runOnScanPool(int numWorkers, const function<void(int)>& run){
+    static scanPool pool;
+    scanJob job;
+    job.run = run;
+    job.numWorkers = numWorkers;
+    job.claimed = 1;
+    job.running = 0;
+    {
+        lock_guard<mutex> guard(pool.lock);
+        while ((int)pool.threads.size() < numWorkers - 1){
+            pool.threads.emplace_back(scanPoolThread, ref(pool));
+        }
+        pool.jobs.push_back(&job);
+    }
+    pool.wakeUp.notify_all();
+    
+    run(0);
+    
+    unique_lock<mutex> guard(pool.lock);
+    auto queued = find(pool.jobs.begin(), pool.jobs.end(), &job);
+    if (queued != pool.jobs.end()){
+        pool.jobs.erase(queued);
+    }
+    job.finished.wait(guard, [&](){
+        return job.running == 0;
+    });
+}
+
+
+//
+// parallelReduce
+//
+// Given row ranges, a number of threads, an empty partial aggregate, a scan function (partial, first row, end row) and a
+// merge function (into, from), cuts the ranges into chunks of SCAN_CHUNK_ROWS rows, hands each worker an equal run of
+// chunks, and lets a worker that finishes early (or that a busy pool never started) have its chunks stolen: a worker out of
+// chunks takes half of another's remaining ones. The workers run on the scan pool (see runOnScanPool). Every worker
+// scans into its own copy of the partial, each on its own cache lines, so the hot loops share nothing; the partials are
+// merged in worker order at the end. Returns the merged aggregate. A scan that fits in one chunk, or one thread, runs on
+// this thread alone.
+//
+template <typename Partial, typename Scan, typename Merge>
+Partial parallelReduce(const vector<pair<int, int>>& rowRanges, int numThreads, const Partial& empty, const Scan& scan, const Merge& merge){
+    vector<pair<int, int>> chunks;
+    for (const pair<int, int>& range : rowRanges){
+        for (int first = range.first; first < range.second; first += min(SCAN_CHUNK_ROWS, range.second - first)){
+            chunks.push_back({first, min(first + SCAN_CHUNK_ROWS, range.second)});
+        }
+    }
+    
+    int numWorkers = max(1, min(numThreads, (int)chunks.size()));
+    if (numWorkers == 1){
+        Partial total = empty;
+        for (const pair<int, int>& chunk : chunks){
+            scan(total, chunk.first, chunk.second);
+        }
+        return total;
+    }
+    
+    struct alignas(64) paddedPartial{
+        Partial value;
+    };
+    vector<paddedPartial> partials(numWorkers, paddedPartial{empty});
+    
+    unique_ptr<chunkRange[]> ranges(new chunkRange[numWorkers]);
+    for (int w = 0; w < numWorkers; ++w){
+        uint64_t front = chunks.size() * w / numWorkers, back = chunks.size() * (w + 1) / numWorkers;
+        ranges[w].bounds.store((front << 32) | back, memory_order_relaxed);
+    }
+    runOnScanPool(numWorkers, [&](int w){
+        do {
+            int chunk;
+            while ((chunk = takeChunk(ranges[w])) >= 0){
+                scan(partials[w].value, chunks[chunk].first, chunks[chunk].second);
+            }
+        } while (stealChunks(ranges.get(), numWorkers, w));
+    });
+    
+    for (int w = 1; w < numWorkers; ++w){
+        merge(partials[0].value, partials[w].value);
+    }
+    return partials[0].value;
+}
+
+
+//
+// quickStats
+//
+// Given total number of stations(S), total number of bike trips(T), stationInfo struct stations array, and the output
+// stream, the program calculates the total bike capacity by looping through the stations array and adding to the 
+// bike capacity counter. Outputs stations, trips, and total bike capacity. No return type.
+void quickStats(int S, int T, const stationInfo stations[], ostream& out){
+    int totalBikeCapacity = 0;
+    for (int i = 0; i < S; ++i){
+        totalBikeCapacity += stations[i].capacity;
+    }
+    
+    out << " stations: " << S << endl;
+    out << " trips: " << T << endl;
+    out << " total bike capacity: " << totalBikeCapacity << endl;
+    
+}
+
+
+// bins fixed at compile time by their upper edges: a value goes in the bin after the last edge it's greater than, so a
+// value equal to an edge is in the lower bin (the way durations has always counted "<= 30 mins"). The edges are a
+// constexpr table and the bin is a sum of comparisons, so there's no branch per value
+template <int... Edges>
+struct fixedEdgeBins{
+    static constexpr int edges[sizeof...(Edges)] = {Edges...};
+    static constexpr bool increasing(){
+        for (size_t k = 1; k < sizeof...(Edges); ++k){
+            if (edges[k] <= edges[k - 1]){
+                return false;
+            }
+        }
+        return sizeof...(Edges) > 0;
+    }
+    static_assert(increasing(), "fixedEdgeBins needs at least one edge, in increasing order");
+    static constexpr int numBins(){
+        return sizeof...(Edges) + 1;
+    }
+    int bin(int value) const{
+        int b = 0;
+        for (int edge : edges){
+            b += (value > edge);
+        }
+        return b;
+    }
+};
+
+
+// bins of a fixed width fixed at compile time, from 0 up to Width * NumBins: a value goes in bin value / Width, and values
+// below 0 or past the last bin (like an invalid start time, -1) are left out (bin -1)
+template <int Width, int NumBins>
+struct fixedWidthBins{
+    static constexpr int numBins(){
+        return NumBins;
+    }
+    int bin(int value) const{
+        return (unsigned)value < (unsigned)(Width * NumBins) ? value / Width : -1;
+    }
+};
+
+
+// bins given at runtime, as a table of the bin of every value 0..size-1 so finding a bin is one load however many bins
+// there are. Values below the table go in bin below and values past it in bin above (-1 to leave them out)
+struct tableBins{
+    vector<short> binOf;
+    short below;
+    short above;
+    int count;
+    int numBins() const{
+        return count;
+    }
+    int bin(int value) const{
+        return (unsigned)value < binOf.size() ? binOf[value] : (value < 0 ? below : above);
+    }
+};
+
+
+//
+// binsFromEdges
+//
+// Given increasing upper edges, a unit the edges are in (e.g. 60 for edges in minutes over values in seconds), and a
+// tableBins by reference, makes bins that count like fixedEdgeBins. No return type.
+//
+void binsFromEdges(const vector<int>& edges, int unit, tableBins& bins){
+    bins.binOf.assign(edges.back() * unit + 1, 0);
+    size_t b = 0;
+    for (int value = 0; value < (int)bins.binOf.size(); ++value){
+        while (b < edges.size() && value > edges[b] * unit){
+            ++b;
+        }
+        bins.binOf[value] = b;
+    }
+    bins.below = 0;
+    bins.above = edges.size();
+    bins.count = edges.size() + 1;
+}
+
+
+//
+// binsFromWidth
+//
+// Given a bin width, the end of the values (bins cover 0..end-1, the last one cut short if the width doesn't divide it),
+// and a tableBins by reference, makes bins that count like fixedWidthBins. No return type.
+//
+void binsFromWidth(int width, int end, tableBins& bins){
+    bins.binOf.resize(end);
+    for (int value = 0; value < end; ++value){
+        bins.binOf[value] = value / width;
+    }
+    bins.below = -1;
+    bins.above = -1;
+    bins.count = (end + width - 1) / width;
+}
+
+
+typedef fixedEdgeBins<1800, 3600, 7200, 18000> durationBins; // the durations command's 5 bins, in seconds
+typedef fixedWidthBins<60, 24> hourBins; // the starting command's 24 hours, in minutes of the day
+
+
+//
+// countInBinsScalar
+//
+// Given bins (fixedEdgeBins, fixedWidthBins or tableBins), a column of values, the number of values(T), and an array of
+// one counter per bin, adds the number of values in each bin to the counters, finding each value's bin with bins.bin.
+// Values left out by the bins aren't counted. No return type.
+//
+template <typename Bins, typename Value>
+void countInBinsScalar(const Bins& bins, const Value values[], int T, long long counts[]){
+    // four interleaved sub-histograms so runs of values in the same bin don't all wait on one counter; slot 0 of each
+    // catches the values left out
+    int slots = bins.numBins() + 1;
+    vector<long long> partial(4 * slots, 0);
+    
+    int i = 0;
+    for (; i + 4 <= T; i += 4){
+        for (int k = 0; k < 4; ++k){
+            partial[k * slots + bins.bin(values[i + k]) + 1]++;
+        }
+    }
+    for (; i < T; ++i){
+        partial[bins.bin(values[i]) + 1]++;
+    }
+    
+    for (int b = 0; b < bins.numBins(); ++b){
+        counts[b] += partial[b + 1] + partial[slots + b + 1] + partial[2 * slots + b + 1] + partial[3 * slots + b + 1];
+    }
+}
+
+
+#ifdef DIVVY_AVX2_KERNELS
+//
+// countLongerThanAVX2
+//
+// Given a column of ints, the number of values(T), and an array of one longerThan counter per edge, counts the values
+// greater than each of the template's edges: compares 8 values per instruction against each edge and subtracts the
+// all-ones compare masks from per-lane counters. No return type.
+//
+template <int... Edges>
+__attribute__((target("avx2")))
+void countLongerThanAVX2(const int values[], int T, long long longerThan[]){
+    constexpr int numEdges = sizeof...(Edges);
+    const int edges[numEdges] = {Edges...};
+    
+    __m256i thresholds[numEdges], over[numEdges];
+    for (int k = 0; k < numEdges; ++k){
+        thresholds[k] = _mm256_set1_epi32(edges[k]);
+        over[k] = _mm256_setzero_si256();
+    }
+    
+    int i = 0;
+    for (; i + 8 <= T; i += 8){
+        __m256i v = _mm256_loadu_si256((const __m256i*)(values + i));
+#pragma GCC unroll 16 // keeps every counter in a register
+        for (int k = 0; k < numEdges; ++k){
+            over[k] = _mm256_sub_epi32(over[k], _mm256_cmpgt_epi32(v, thresholds[k]));
+        }
+    }
+    
+    // add up the 8 lanes of each counter, then finish the tail one value at a time
+    for (int k = 0; k < numEdges; ++k){
+        alignas(32) unsigned lanes[8];
+        _mm256_store_si256((__m256i*)lanes, over[k]);
+        longerThan[k] = 0;
+        for (int lane = 0; lane < 8; ++lane){
+            longerThan[k] += lanes[lane];
+        }
+        for (int j = i; j < T; ++j){
+            longerThan[k] += (values[j] > edges[k]);
+        }
+    }
+}
+
+
+//
+// multiplyHighDivides
+//
+// Returns true if (value * ceil(65536 / Width)) >> 16, what _mm256_mulhi_epu16 works out, is value / Width for every
+// value in the template's bins and lands past the last bin for every other 16-bit value (an invalid start time, -1, is
+// 65535 unsigned), so countInWidthBinsAVX2 can use it. Worked out at compile time.
+//
+template <int Width, int NumBins>
+constexpr bool multiplyHighDivides(){
+    unsigned multiplier = (65536 + Width - 1) / Width;
+    if (multiplier > 65535){
+        return false;
+    }
+    for (unsigned value = 0; value < 65536; ++value){
+        unsigned bin = (value * multiplier) >> 16;
+        if (value < (unsigned)(Width * NumBins) ? bin != value / Width : bin < (unsigned)NumBins){
+            return false;
+        }
+    }
+    return true;
+}
+
+
+//
+// countInWidthBinsAVX2
+//
+// Given a column of shorts, the number of values(T), and an array of one counter per bin, adds the values in each of
+// the template's bins to the counters: works on 16 values at a time, turns values into bins with a multiply-high (see
+// multiplyHighDivides), then compares against every bin and counts in 16-bit lanes, flushing the lanes before they can
+// overflow. No return type.
+//
+template <int Width, int NumBins>
+__attribute__((target("avx2")))
+void countInWidthBinsAVX2(const short values[], int T, long long counts[]){
+    const __m256i divide = _mm256_set1_epi16((short)((65536 + Width - 1) / Width));
+    
+    int i = 0;
+    while (i + 16 <= T){
+        // each lane gains at most 1 per iteration, so 65535 iterations fit in an unsigned 16-bit lane
+        long long blockEnd = i + 16LL * 65535;
+        if (blockEnd > T){
+            blockEnd = T;
+        }
+        
+        __m256i binCounts[NumBins];
+        for (int b = 0; b < NumBins; ++b){
+            binCounts[b] = _mm256_setzero_si256();
+        }
+        
+        for (; i + 16 <= blockEnd; i += 16){
+            __m256i v = _mm256_loadu_si256((const __m256i*)(values + i));
+            __m256i bin = _mm256_mulhi_epu16(v, divide);
+#pragma GCC unroll 32
+            for (int b = 0; b < NumBins; ++b){
+                binCounts[b] = _mm256_sub_epi16(binCounts[b], _mm256_cmpeq_epi16(bin, _mm256_set1_epi16(b)));
+            }
+        }
+        
+        for (int b = 0; b < NumBins; ++b){
+            alignas(32) unsigned short lanes[16];
+            _mm256_store_si256((__m256i*)lanes, binCounts[b]);
+            for (int lane = 0; lane < 16; ++lane){
+                counts[b] += lanes[lane];
+            }
+        }
+    }
+    
+    countInBinsScalar(fixedWidthBins<Width, NumBins>(), values + i, T - i, counts);
+}
+
+
+//
+// cpuHasAVX2
+//
+// Returns true if the CPU running the program supports AVX2 (checked once).
+//
+bool cpuHasAVX2(){
+    static const bool hasAVX2 = __builtin_cpu_supports("avx2");
+    return hasAVX2;
+}
+#endif
+
+
+//
+// countInBins
+//
+// Given bins, a column of values, the number of values(T), and an array of one counter per bin, adds the number of
+// values in each bin to the counters (see countInBinsScalar). No return type.
+//
+template <typename Bins, typename Value>
+void countInBins(const Bins& bins, const Value values[], int T, long long counts[]){
+    countInBinsScalar(bins, values, T, counts);
+}
+
+
+//
+// countInBins
+//
+// fixedEdgeBins over ints (the durations command's bins): on a CPU with AVX2, counts the values longer than each of the
+// template's edges and takes the bins from the differences; otherwise counts with bins.bin. No return type.
+//
+template <int... Edges>
+void countInBins(const fixedEdgeBins<Edges...>& bins, const int values[], int T, long long counts[]){
+#ifdef DIVVY_AVX2_KERNELS
+    if (cpuHasAVX2()){
+        constexpr int numEdges = sizeof...(Edges);
+        long long longerThan[numEdges];
+        countLongerThanAVX2<Edges...>(values, T, longerThan);
+        counts[0] += T - longerThan[0];
+        for (int k = 1; k < numEdges; ++k){
+            counts[k] += longerThan[k - 1] - longerThan[k];
+        }
+        counts[numEdges] += longerThan[numEdges - 1];
+        return;
+    }
+#endif
+    countInBinsScalar(bins, values, T, counts);
+}
+
+
+//
+// countInBins
+//
+// fixedWidthBins over shorts (the starting command's hours): on a CPU with AVX2, and if the template's width can be
+// divided by with a multiply-high and there are few enough bins to keep a counter register each, counts with
+// countInWidthBinsAVX2; otherwise counts with bins.bin. No return type.
+//
+template <int Width, int NumBins>
+void countInBins(const fixedWidthBins<Width, NumBins>& bins, const short values[], int T, long long counts[]){
+#ifdef DIVVY_AVX2_KERNELS
+    if constexpr (NumBins <= 32 && multiplyHighDivides<Width, NumBins>()){
+        if (cpuHasAVX2()){
+            countInWidthBinsAVX2<Width, NumBins>(values, T, counts);
+            return;
+        }
+    }
+#endif
+    countInBinsScalar(bins, values, T, counts);
+}
+
+
+//
+// countBinsInRanges
+//
+// Given a trip column, row ranges, the number of scan threads, bins, and a counts vector by reference, sets counts to the
+// number of rows of the ranges in each bin, each thread running countInBins on the chunks it takes and the threads' counts
+// added up at the end (see parallelReduce). No return type.
+//
+template <typename Bins, typename Value>
+void countBinsInRanges(const columnArray<Value>& column, const vector<pair<int, int>>& ranges, int numThreads, const Bins& bins, vector<long long>& counts){
+    counts = parallelReduce(ranges, numThreads, vector<long long>(bins.numBins(), 0),
+        [&](vector<long long>& binCounts, int first, int end){
+            countInBins(bins, column.data() + first, end - first, binCounts.data());
+        },
+        [](vector<long long>& into, const vector<long long>& from){
+            for (size_t b = 0; b < into.size(); ++b){
+                into[b] += from[b];
+            }
+        });
+}
+
+
+//
+// parseBins
+//
+// Given a bins argument (a number of minutes, or edges in minutes separated by commas, ending in "m"), whether it's for
+// starting, and a vector by reference, reads the bins. For durations the vector gets the upper edges in minutes: the
+// edges as given (increasing), or every multiple of a single number up to 5 hours. For starting it gets the one bin width,
+// which has to be 1..1440 minutes. Returns false if the argument isn't one of those.
+//
+bool parseBins(const string& arg, bool forStarting, vector<int>& edges){
+    edges.clear();
+    if (arg.size() < 2 || arg.back() != 'm'){
+        return false;
+    }
+    size_t pos = 0, end = arg.size() - 1;
+    while (pos < end){
+        size_t comma = min(arg.find(',', pos), end);
+        int minutes;
+        if (!parseInt(string_view(arg).substr(pos, comma - pos), minutes) || minutes <= 0 || minutes > 1440 ||
+            (!edges.empty() && minutes <= edges.back()) || edges.size() >= 64){
+            return false;
+        }
+        edges.push_back(minutes);
+        pos = comma + 1;
+    }
+    
+    if (forStarting){
+        return edges.size() == 1;
+    }
+    if (edges.size() == 1){
+        int width = edges[0];
+        for (int edge = 2 * width; edge <= 300; edge += width){
+            edges.push_back(edge);
+        }
+    }
+    return !edges.empty();
+}
+
+
+//
+// durations
+//
+// Given the number of trips in each of the 5 duration bins (<= 30 mins, 30..60 mins, 1-2 hrs, 2-5 hrs, > 5 hrs) and the
+// output stream, outputs the counter for the 5 categories. No return type.
+//
+void durations(const long long counts[5], ostream& out){
+    out << " trips <= 30 mins: " << counts[0] << endl;
+    out << " trips 30..60 mins: " << counts[1] << endl;
+    out << " trips 1-2 hrs: " << counts[2] << endl;
+    out << " trips 2-5 hrs: " << counts[3] << endl;
+    out << " trips > 5 hrs: " << counts[4] << endl;
+}
+
+
+//
+// durationsInBins
+//
+// Given the upper edges of the duration bins in minutes, the number of trips in each bin, and the output stream, outputs
+// every bin's count the way durations does (<= first edge, edge..next edge, > last edge). No return type.
+//
+void durationsInBins(const vector<int>& edges, const vector<long long>& counts, ostream& out){
+    out << " trips <= " << edges[0] << " mins: " << counts[0] << endl;
+    for (size_t b = 1; b < edges.size(); ++b){
+        out << " trips " << edges[b - 1] << ".." << edges[b] << " mins: " << counts[b] << endl;
+    }
+    out << " trips > " << edges.back() << " mins: " << counts[edges.size()] << endl;
+}
+
+
+//
+// startingTimes
+//
+// Given the number of trips starting in each of the 24 hours and the output stream, outputs the count for every hour.
+// No return type.
+//
+void startingTimes(const long long hours[24], ostream& out){
+    // output results
+    for (int h = 0; h < 24; ++h){
+        out << " " << h << ": " << hours[h] << endl;
+    }
+}
+
+
+//
+// startingTimesInBins
+//
+// Given the width of the start time bins in minutes, the number of trips starting in each bin, and the output stream,
+// outputs the count for every bin labeled with its start time (H:MM). No return type.
+//
+void startingTimesInBins(int width, const vector<long long>& counts, ostream& out){
+    for (size_t b = 0; b < counts.size(); ++b){
+        int mins = b * width;
+        out << " " << mins / 60 << ":" << (mins % 60 < 10 ? "0" : "") << mins % 60 << ": " << counts[b] << endl;
+    }
+}
+
+
+const double PI = 3.14159265;
+const double EARTH_RAD = 3963.1; // statue miles
+
+
+//
+// unitVector
+//
+// Given a position (lat, long) in degrees, returns the point on the unit sphere by reference as (x, y, z) =
+// (cos(lat)cos(long), cos(lat)sin(long), sin(lat)). The great-circle distance between two points is
+// earth_rad * acos(dot product of their unit vectors), which is the formula distBetween2Points used (originally written by
+// Prof. Hummel, U. of Illinois, Chicago, Spring 2021; reference: http://www8.nau.edu/cvm/latlon_formula.html) with the
+// terms of each point grouped together so a station's can be computed once. No return type.
+//
+void unitVector(double lat, double lon, double& x, double& y, double& z){
+    double lat_rad = lat * PI / 180.0;
+    double long_rad = lon * PI / 180.0;
+    
+    x = cos(lat_rad) * cos(long_rad);
+    y = cos(lat_rad) * sin(long_rad);
+    z = sin(lat_rad);
+}
+
+
+//
+// milesFromDot
+//
+// Given the dot product of two unit vectors, returns the distance in miles between the two points. Rounding can push the
+// dot product of two nearby points just past 1, which is clamped so it comes out as 0 instead of NaN.
+//
+double milesFromDot(double dot){
+    return EARTH_RAD * acos(min(dot, 1.0));
+}
+
+
+//
+// nearDots
+//
+// Given the unit vector columns, a range [begin, end) of them, the query point's unit vector (qx, qy, qz), a cutoff, and
+// vectors of hits and their dot products by reference, appends every k in the range whose dot product with the query
+// point is >= cutoff. No return type.
+//
+void nearDots(const double unitX[], const double unitY[], const double unitZ[], int begin, int end, double qx, double qy, double qz, double cutoff, vector<int>& hits, vector<double>& dots){
+    for (int k = begin; k < end; ++k){
+        double dot = unitX[k] * qx + unitY[k] * qy + unitZ[k] * qz;
+        if (dot >= cutoff){
+            hits.push_back(k);
+            dots.push_back(dot);
+        }
+    }
+}
+
+
+#ifdef DIVVY_AVX2_KERNELS
+//
+// nearDotsAVX2
+//
+// AVX2 version of nearDots: computes 4 dot products per instruction (multiplies and adds in the same order as nearDots,
+// so the results are identical) and only goes back to the scalar side for lanes that pass the cutoff. No return type.
+//
+__attribute__((target("avx2")))
+void nearDotsAVX2(const double unitX[], const double unitY[], const double unitZ[], int begin, int end, double qx, double qy, double qz, double cutoff, vector<int>& hits, vector<double>& dots){
+    const __m256d queryX = _mm256_set1_pd(qx);
+    const __m256d queryY = _mm256_set1_pd(qy);
+    const __m256d queryZ = _mm256_set1_pd(qz);
+    const __m256d minDot = _mm256_set1_pd(cutoff);
+    
+    int k = begin;
+    for (; k + 4 <= end; k += 4){
+        __m256d dot = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(_mm256_loadu_pd(unitX + k), queryX),
+                                                  _mm256_mul_pd(_mm256_loadu_pd(unitY + k), queryY)),
+                                    _mm256_mul_pd(_mm256_loadu_pd(unitZ + k), queryZ));
+        int mask = _mm256_movemask_pd(_mm256_cmp_pd(dot, minDot, _CMP_GE_OQ));
+        if (mask != 0){
+            alignas(32) double lanes[4];
+            _mm256_store_pd(lanes, dot);
+            for (int lane = 0; lane < 4; ++lane){
+                if (mask & (1 << lane)){
+                    hits.push_back(k + lane);
+                    dots.push_back(lanes[lane]);
+                }
+            }
+        }
+    }
+    
+    nearDots(unitX, unitY, unitZ, k, end, qx, qy, qz, cutoff, hits, dots);
+}
+#endif
+
+
+//
+// stationsWithinDot
+//
+// Given the stationGrid, a range [begin, end) of its unit vector columns, the query point's unit vector, a cutoff, and the
+// hits and dots vectors by reference, runs the fastest nearDots kernel the CPU supports over the range. No return type.
+//
+void stationsWithinDot(const stationGrid& grid, int begin, int end, double qx, double qy, double qz, double cutoff, vector<int>& hits, vector<double>& dots){
+    PROFILE_COUNT(PROF_DISTANCE_EVALS, end - begin);
+#ifdef DIVVY_AVX2_KERNELS
+    if (cpuHasAVX2()){
+        nearDotsAVX2(grid.unitX.data(), grid.unitY.data(), grid.unitZ.data(), begin, end, qx, qy, qz, cutoff, hits, dots);
+        return;
+    }
+#endif
+    nearDots(grid.unitX.data(), grid.unitY.data(), grid.unitZ.data(), begin, end, qx, qy, qz, cutoff, hits, dots);
+}
+
+
+//
+// buildStationGrid
+//
+// Given stationInfo struct stations array, total number of stations(S), and a stationGrid by reference, the program sizes
+// the grid cells from the stations' bounding box so a cell holds about two stations on average, then buckets every
+// station position into its cell (counting sort) and stores each station's unit vector in cell order. Stations without
+// valid coordinates are left out. No return type.
+//
+void buildStationGrid(const stationInfo stations[], int S, stationGrid& grid){
+    double minLat = 90.0, maxLat = -90.0, minLong = 180.0, maxLong = -180.0;
+    int placed = 0;
+    for (int i = 0; i < S; ++i){
+        if (isfinite(stations[i].latitude) && isfinite(stations[i].longitude)){
+            minLat = min(minLat, stations[i].latitude);
+            maxLat = max(maxLat, stations[i].latitude);
+            minLong = min(minLong, stations[i].longitude);
+            maxLong = max(maxLong, stations[i].longitude);
+            placed++;
+        }
+    }
+    if (placed == 0){
+        minLat = maxLat = minLong = maxLong = 0.0;
+    }
+    
+    double area = max(maxLat - minLat, 1e-6) * max(maxLong - minLong, 1e-6);
+    grid.cellSize = max(sqrt(2.0 * area / max(placed, 1)), 1e-4);
+    grid.minLat = minLat;
+    grid.minLong = minLong;
+    grid.rows = (int)((maxLat - minLat) / grid.cellSize) + 1;
+    grid.cols = (int)((maxLong - minLong) / grid.cellSize) + 1;
+    
+    vector<int> cellOf(S, -1);
+    grid.cellOffsets.assign((size_t)grid.rows * grid.cols + 1, 0);
+    for (int i = 0; i < S; ++i){
+        if (isfinite(stations[i].latitude) && isfinite(stations[i].longitude)){
+            int row = min((int)((stations[i].latitude - minLat) / grid.cellSize), grid.rows - 1);
+            int col = min((int)((stations[i].longitude - minLong) / grid.cellSize), grid.cols - 1);
+            cellOf[i] = row * grid.cols + col;
+            grid.cellOffsets[cellOf[i] + 1]++;
+        }
+    }
+    for (size_t c = 0; c + 1 < grid.cellOffsets.size(); ++c){
+        grid.cellOffsets[c + 1] += grid.cellOffsets[c];
+    }
+    
+    grid.cellStations.resize(placed);
+    vector<int> next(grid.cellOffsets.begin(), grid.cellOffsets.end() - 1);
+    for (int i = 0; i < S; ++i){
+        if (cellOf[i] >= 0){
+            grid.cellStations[next[cellOf[i]]++] = i;
+        }
+    }
+    
+    grid.unitX.resize(placed);
+    grid.unitY.resize(placed);
+    grid.unitZ.resize(placed);
+    for (int k = 0; k < placed; ++k){
+        const stationInfo& station = stations[grid.cellStations[k]];
+        unitVector(station.latitude, station.longitude, grid.unitX[k], grid.unitY[k], grid.unitZ[k]);
+    }
+}
+
+
+//
+// gridRanges
+//
+// Given the stationGrid, a position (latitude, longitude), a distance D in miles, and a vector of [begin, end) ranges by
+// reference, collects the range of the grid's unit vector columns for every row of cells that overlaps a box which is
+// guaranteed to contain all points within D miles. Returns false (collecting nothing) if the box can't be bounded on the
+// grid, i.e. it reaches a pole or wraps around the 180th meridian, so the caller should check every station.
+//
+bool gridRanges(const stationGrid& grid, double latitude, double longitude, double D, vector<pair<int, int>>& ranges){
+    // a point within D miles is at most D / EARTH_RAD radians of latitude away; pad that so rounding in the distance
+    // (acos near 1 in particular) can never put a station in range that the box leaves out
+    double latSpan = (D / EARTH_RAD) * 180.0 / PI;
+    latSpan = latSpan * 1.01 + 1e-3;
+    
+    double maxAbsLat = fabs(latitude) + latSpan;
+    if (maxAbsLat >= 89.0){
+        return false;
+    }
+    double longSpan = latSpan / cos(maxAbsLat * PI / 180.0);
+    if (longitude - longSpan < -180.0 || longitude + longSpan > 180.0){
+        return false;
+    }
+    
+    int firstRow = (int)floor((latitude - latSpan - grid.minLat) / grid.cellSize);
+    int lastRow = (int)floor((latitude + latSpan - grid.minLat) / grid.cellSize);
+    int firstCol = (int)floor((longitude - longSpan - grid.minLong) / grid.cellSize);
+    int lastCol = (int)floor((longitude + longSpan - grid.minLong) / grid.cellSize);
+    firstRow = max(firstRow, 0);
+    firstCol = max(firstCol, 0);
+    lastRow = min(lastRow, grid.rows - 1);
+    lastCol = min(lastCol, grid.cols - 1);
+    
+    for (int row = firstRow; row <= lastRow && firstCol <= lastCol; ++row){
+        int firstCell = row * grid.cols + firstCol;
+        int lastCell = row * grid.cols + lastCol;
+        if (grid.cellOffsets[firstCell] < grid.cellOffsets[lastCell + 1]){
+            ranges.emplace_back(grid.cellOffsets[firstCell], grid.cellOffsets[lastCell + 1]);
+        }
+    }
+    return true;
+}
+
+
+//
+// stationsNearMe
+//
+// Given stationInfo struct stations array, the stationGrid, the position (latitude, longitude), the distance D, the
+// queryScratch for its buffers, and the output stream, it asks the grid which ranges of stations could be within D and runs the dot product kernel over just
+// those. Only the stations that pass the kernel's cutoff get the acos for their distance; the ones within D are kept as
+// (distance, position) pairs and sorted from nearest to farthest to output them. The stations array isn't modified.
+// No return type.
+//
+void stationsNearMe(const stationInfo stations[], const stationGrid& grid, double latitude, double longitude, double D, queryScratch& scratch, ostream& out){
+    vector<pair<int, int>>& ranges = scratch.ranges; // [begin, end) ranges of the grid's unit vector columns
+    ranges.clear();
+    if (!(D >= 0.0)){ // negative (or NaN) radius, nothing can be within it
+    } else if (!isfinite(latitude) || !isfinite(longitude) || !gridRanges(grid, latitude, longitude, D, ranges)){
+        ranges.emplace_back(0, (int)grid.cellStations.size()); // the grid can't bound this query, check every station
+    }
+    
+    // a station is within D exactly when its dot product with the query point is at least cos(D / EARTH_RAD). The cutoff
+    // is lowered a little so stations right on the boundary, where rounding could go either way, get the exact check below
+    double qx, qy, qz;
+    unitVector(latitude, longitude, qx, qy, qz);
+    double angle = D / EARTH_RAD;
+    double cutoff = (angle >= PI) ? -2.0 : cos(angle) - 1e-12;
+    
+    vector<int>& hits = scratch.hits; // positions in the grid's unit vector columns
+    vector<double>& dots = scratch.dots;
+    hits.clear();
+    dots.clear();
+    for (const pair<int, int>& range : ranges){
+        stationsWithinDot(grid, range.first, range.second, qx, qy, qz, cutoff, hits, dots);
+    }
+    
+    vector<pair<double, int>>& nearby = scratch.nearby; // (distance, position in stations array)
+    nearby.clear();
+    for (size_t h = 0; h < hits.size(); ++h){
+        double distance = milesFromDot(dots[h]);
+        if (distance <= D){
+            nearby.emplace_back(distance, grid.cellStations[hits[h]]);
+        }
+    }
+    sort(nearby.begin(), nearby.end()); // ties on distance keep load order
+     
+    out << " The following stations are within " << D << " miles of (" << latitude << ", " << longitude << "):" << endl;
+    
+    for (const pair<double, int>& station : nearby){
+        const stationInfo& info = stations[station.second];
+        out << " station " << info.stationID << " (" << info.name << "): " << station.first << " miles" << endl;
+    }
+    
+    if(nearby.empty()){
+        out << " none found" << endl;
+    }
+}
+
+
+//
+// updateStationTripCounts
+//
+// Given tripColumns struct trips, total number of trips(T), total number of station indices, the number of threads, and
+// the stationTripCounts by reference, the program counts the trips that aren't in the counts yet (rows countedTrips..T-1)
+// in one pass, adding 1 to the start station and 1 to the end station if it's a different station. The rows are split
+// across the threads, each counting into its own array, and the arrays are added up at the end (see parallelReduce).
+// No return type.
+//
+void updateStationTripCounts(const tripColumns& trips, int T, int numStationIDs, int numThreads, stationTripCounts& counts){
+    counts.trips.resize(numStationIDs, 0); // the dictionary may have grown since the last update
+    
+    vector<int> added = parallelReduce({{counts.countedTrips, T}}, numThreads, vector<int>(numStationIDs, 0),
+        [&](vector<int>& stationCounts, int first, int end){
+            for(int k = first; k < end; ++k){
+                int startStation = trips.startStation[k];
+                int endStation = trips.endStation[k];
+                stationCounts[startStation] += 1;
+                if(endStation != startStation){ // only counting a trip once for same start and end station
+                    stationCounts[endStation] += 1;
+                }
+            }
+        },
+        [&](vector<int>& into, const vector<int>& from){
+            for (int i = 0; i < numStationIDs; ++i){
+                into[i] += from[i];
+            }
+        });
+    for (int i = 0; i < numStationIDs; ++i){
+        counts.trips[i] += added[i];
+    }
+    counts.countedTrips = T;
+}
+
+
+//
+// sortStationsByName
+//
+// Given stationInfo struct stations array, total number of stations(S), and a nameOrder vector by reference, the program
+// fills nameOrder with the station positions sorted alphabetically by name (stable, so equal names keep load order).
+// Names never change after load, so this is done once and reused by every command that lists stations. No return type.
+//
+void sortStationsByName(const stationInfo stations[], int S, vector<int>& nameOrder){
+    nameOrder.resize(S);
+    for (int i = 0; i < S; ++i){
+        nameOrder[i] = i;
+    }
+    stable_sort(nameOrder.begin(), nameOrder.end(), [stations](int a, int b){
+        PROFILE_COUNT(PROF_STRING_COMPARES, 1);
+        return stations[a].name < stations[b].name;
+    });
+}
+
+
+//
+// listAllStations
+//
+// Given stationInfo struct stations array, the stationTripCounts, the station nameOrder, and the output stream, outputs all
+// the stations in name order with their number of trips. No return type.
+//
+void listAllStations(const stationInfo stations[], const stationTripCounts& counts, const vector<int>& nameOrder, ostream& out){
+    // output the stations
+    for(int i : nameOrder){
+        out << stations[i].name << " (" << stations[i].stationID << ") @ ("<< stations[i].latitude << ", ";
+        out << stations[i].longitude << "), " << stations[i].capacity << " capacity, " << counts.trips[stations[i].index] << " trips" << endl;
+    }
+  
+}
+
+
+//
+// trigramAt
+//
+// Given a string and a position, returns the 3 bytes starting at that position packed into one int.
+//
+uint32_t trigramAt(string_view text, size_t pos){
+    return ((uint32_t)(unsigned char)text[pos] << 16) | ((uint32_t)(unsigned char)text[pos + 1] << 8) | (unsigned char)text[pos + 2];
+}
+
+
+//
+// buildNameIndex
+//
+// Given stationInfo struct stations array, the station nameOrder, and a nameIndex by reference, collects a
+// (trigram, rank) pair for every distinct trigram of every name, sorts the pairs and packs them into the index's posting
+// lists. No return type.
+//
+void buildNameIndex(const stationInfo stations[], const vector<int>& nameOrder, nameIndex& names){
+    vector<pair<uint32_t, int>> grams;
+    for (size_t rank = 0; rank < nameOrder.size(); ++rank){
+        string_view name = stations[nameOrder[rank]].name;
+        for (size_t pos = 0; pos + 3 <= name.size(); ++pos){
+            grams.push_back(make_pair(trigramAt(name, pos), (int)rank));
+        }
+    }
+    sort(grams.begin(), grams.end());
+    grams.erase(unique(grams.begin(), grams.end()), grams.end()); // a name repeating a trigram is listed once
+    
+    names.gramKeys.clear();
+    names.gramOffsets.clear();
+    names.gramRanks.resize(grams.size());
+    for (size_t j = 0; j < grams.size(); ++j){
+        if (j == 0 || grams[j].first != grams[j - 1].first){
+            names.gramKeys.push_back(grams[j].first);
+            names.gramOffsets.push_back(j);
+        }
+        names.gramRanks[j] = grams[j].second;
+    }
+    names.gramOffsets.push_back(grams.size());
+}
+
+
+//
+// searchNameIndex
+//
+// Given stationInfo struct stations array, the station nameOrder, the nameIndex, a target string, and the queryScratch
+// (matching ranks go in its matches), finds the stations whose name contains target. For targets of 3 or more bytes, the posting lists of the
+// target's trigrams are intersected, shortest first, and only the ranks left are checked with find; shorter targets check
+// every name. The ranks come out in increasing order, which is name order. No return type.
+//
+void searchNameIndex(const stationInfo stations[], const vector<int>& nameOrder, const nameIndex& names, const string& target, queryScratch& scratch){
+    vector<int>& matches = scratch.matches;
+    vector<int>& candidates = scratch.candidates;
+    matches.clear();
+    candidates.clear();
+    
+    if (target.size() < 3){
+        candidates.resize(nameOrder.size());
+        for (size_t rank = 0; rank < nameOrder.size(); ++rank){
+            candidates[rank] = rank;
+        }
+    } else {
+        // posting list of each trigram as a [begin, end) range of gramRanks
+        vector<pair<int, int>>& lists = scratch.ranges;
+        lists.clear();
+        for (size_t pos = 0; pos + 3 <= target.size(); ++pos){
+            uint32_t gram = trigramAt(target, pos);
+            auto it = lower_bound(names.gramKeys.begin(), names.gramKeys.end(), gram);
+            if (it == names.gramKeys.end() || *it != gram){
+                return; // no name has this trigram
+            }
+            size_t g = it - names.gramKeys.begin();
+            lists.push_back(make_pair(names.gramOffsets[g], names.gramOffsets[g + 1]));
+        }
+        sort(lists.begin(), lists.end(), [](const pair<int, int>& a, const pair<int, int>& b){
+            return a.second - a.first < b.second - b.first;
+        });
+        
+        candidates.assign(names.gramRanks.begin() + lists[0].first, names.gramRanks.begin() + lists[0].second);
+        vector<int>& kept = scratch.kept;
+        for (size_t k = 1; k < lists.size() && !candidates.empty(); ++k){
+            kept.clear();
+            set_intersection(candidates.begin(), candidates.end(), names.gramRanks.begin() + lists[k].first,
+                             names.gramRanks.begin() + lists[k].second, back_inserter(kept));
+            candidates.swap(kept);
+        }
+    }
+    
+    // the trigrams only say a name might contain target, so each candidate is checked
+    PROFILE_COUNT(PROF_STRING_COMPARES, candidates.size());
+    for (int rank : candidates){
+        if (stations[nameOrder[rank]].name.find(target) != string::npos){
+            matches.push_back(rank);
+        }
+    }
+}
+
+
+//
+// findStations
+//
+// Given stationInfo struct stations array, the stationTripCounts, the station nameOrder, the nameIndex, the targetKey
+// string, the queryScratch, and the output stream, the program looks up the stations whose name contains the targetKey string in the name
+// index. It then outputs either none found or the station info, in name order. No return type.
+//
+void findStations(const stationInfo stations[], const stationTripCounts& counts, const vector<int>& nameOrder, const nameIndex& names, const string& targetKey, queryScratch& scratch, ostream& out){
+    searchNameIndex(stations, nameOrder, names, targetKey, scratch);
+    const vector<int>& matches = scratch.matches;
+    
+    for(int rank : matches){
+        int i = nameOrder[rank];
+        out << stations[i].name << " (" << stations[i].stationID << ") @ ("<< stations[i].latitude << ", ";
+        out << stations[i].longitude << "), " << stations[i].capacity << " capacity, " << counts.trips[stations[i].index] << " trips" << endl;
+    }
+    
+    // checking if no match found
+    if(matches.empty()){ // no station contain targetKey string
+        out << " none found" << endl;
+    }
+}
+
+
+//
+// setMinuteTotals
+//
+// Given the number of trips and their total duration (seconds) for each start minute and a timeIndex by reference, fills
+// in the index's prefix sums. No return type.
+//
+void setMinuteTotals(const vector<long long>& tripsInMinute, const vector<long long>& secondsInMinute, timeIndex& index){
+    index.tripsBefore[0] = 0;
+    index.secondsBefore[0] = 0;
+    for (int m = 0; m < 1440; ++m){
+        index.tripsBefore[m + 1] = index.tripsBefore[m] + tripsInMinute[m];
+        index.secondsBefore[m + 1] = index.secondsBefore[m] + secondsInMinute[m];
+    }
+}
+
+
+//
+// addTripsToTimeIndex
+//
+// Given tripColumns struct trips, the first row that isn't in the index yet, total # of trips, total # of station indices,
+// and a timeIndex by reference, the program adds rows firstRow..T-1 to the index: it adds their counts and duration to
+// the per-minute totals and redoes the prefix sums, then buckets their start stations by minute and merges each minute's
+// bucket into the minute's station list, keeping each station once per minute. The cost depends on the new rows and the
+// size of the index, not on the rows already in it. Trips with an invalid start time are left out. No return type.
+//
+void addTripsToTimeIndex(const tripColumns& trips, int firstRow, int T, int numStationIDs, timeIndex& index){
+    vector<long long> tripsInMinute(1440, 0);
+    vector<long long> secondsInMinute(1440, 0);
+    for (int m = 0; m < 1440; ++m){
+        tripsInMinute[m] = index.tripsBefore[m + 1] - index.tripsBefore[m];
+        secondsInMinute[m] = index.secondsBefore[m + 1] - index.secondsBefore[m];
+    }
+    
+    vector<int> bucketStart(1441, 0);
+    for (int j = firstRow; j < T; ++j){
+        int mins = trips.startMins[j];
+        if (mins >= 0){
+            tripsInMinute[mins]++;
+            secondsInMinute[mins] += trips.duration[j];
+            bucketStart[mins + 1]++;
+        }
+    }
+    
+    setMinuteTotals(tripsInMinute, secondsInMinute, index);
+    
+    // bucket every new trip's start station by minute (counting sort)...
+    for (int m = 0; m < 1440; ++m){
+        bucketStart[m + 1] += bucketStart[m];
+    }
+    vector<int> bucketed(bucketStart[1440]);
+    vector<int> next(bucketStart.begin(), bucketStart.end() - 1);
+    for (int j = firstRow; j < T; ++j){
+        int mins = trips.startMins[j];
+        if (mins >= 0){
+            bucketed[next[mins]++] = trips.startStation[j];
+        }
+    }
+    
+    // ...then append each minute's new stations to the ones it already had, using the last minute a station was kept in as
+    // the "seen" mark
+    vector<int> lastMinuteSeen(numStationIDs, -1);
+    vector<int> minuteOffsets(1441, 0);
+    vector<int> minuteStations;
+    minuteStations.reserve(index.minuteStations.size() + bucketed.size());
+    for (int m = 0; m < 1440; ++m){
+        minuteOffsets[m] = minuteStations.size();
+        for (int k = index.minuteOffsets[m]; k < index.minuteOffsets[m + 1]; ++k){
+            lastMinuteSeen[index.minuteStations[k]] = m;
+            minuteStations.push_back(index.minuteStations[k]);
+        }
+        for (int k = bucketStart[m]; k < bucketStart[m + 1]; ++k){
+            int station = bucketed[k];
+            if (lastMinuteSeen[station] != m){
+                lastMinuteSeen[station] = m;
+                minuteStations.push_back(station);
+            }
+        }
+    }
+    minuteOffsets[1440] = minuteStations.size();
+    index.minuteOffsets.swap(minuteOffsets);
+    index.minuteStations.swap(minuteStations);
+}
+
+
+//
+// buildTimeIndex
+//
+// Given tripColumns struct trips, total # of trips, total # of station indices, and a timeIndex by reference, the program
+// starts the index empty and adds every trip to it (see addTripsToTimeIndex). No return type.
+//
+void buildTimeIndex(const tripColumns& trips, int T, int numStationIDs, timeIndex& index){
+    fill(index.tripsBefore, index.tripsBefore + 1441, 0);
+    fill(index.secondsBefore, index.secondsBefore + 1441, 0);
+    index.minuteOffsets.assign(1441, 0);
+    index.minuteStations.clear();
+    addTripsToTimeIndex(trips, 0, T, numStationIDs, index);
+}
+
+
+//
+// addMinuteRange
+//
+// Given the timeIndex, the first and last minute of a range (inclusive, clamped to 0..1439), a tripFound array indexed by
+// station index, trips by reference, and total seconds by reference, adds the trips and duration that start in the range
+// from the prefix sums and marks the range's start stations in tripFound. No return type.
+//
+void addMinuteRange(const timeIndex& index, int firstMin, int lastMin, bool tripFound[], long long& countTrips, long long& totalSeconds){
+    firstMin = max(firstMin, 0);
+    lastMin = min(lastMin, 1439);
+    if (firstMin > lastMin){
+        return;
+    }
+    
+    countTrips += index.tripsBefore[lastMin + 1] - index.tripsBefore[firstMin];
+    totalSeconds += index.secondsBefore[lastMin + 1] - index.secondsBefore[firstMin];
+    
+    for (int k = index.minuteOffsets[firstMin]; k < index.minuteOffsets[lastMin + 1]; ++k){
+        tripFound[index.minuteStations[k]] = true;
+    }
+}
+
+
+//
+// countTripsAndDuration
+//
+// Given the timeIndex, a tripFound array indexed by station index, time1Mins, time2Mins, trips by refernce, and duration
+// by reference, it examines two cases. If it crosses midnight(time1Mins > time2Mins), adds the trips that start between
+// time1 and 23:59 and between 0:00 and time2. Else, adds the trips that start between time1 and time2. Counts and
+// duration come from the prefix sums, so the cost doesn't depend on the number of trips. No return type.
+//
+void countTripsAndDuration(const timeIndex& index, bool tripFound[], int time1Mins, int time2Mins, int& countTrips, double& totalDuration){
+    long long trips = 0;
+    long long seconds = 0;
+    
+    if(time1Mins > time2Mins){ // crosses midnight
+        addMinuteRange(index, time1Mins, 1439, tripFound, trips, seconds);
+        addMinuteRange(index, 0, time2Mins, tripFound, trips, seconds);
+    } else { // time1 < time2
+        addMinuteRange(index, time1Mins, time2Mins, tripFound, trips, seconds);
+    }
+    
+    countTrips += trips;
+    totalDuration += seconds / 60.0; // minute conversion
+}
+
+
+//
+// clearedStationFlags
+//
+// Given the queryScratch and total # of station indices, returns the scratch's station flags with the first numStationIDs
+// set to false, growing them first if there are more stations than before.
+//
+bool* clearedStationFlags(queryScratch& scratch, int numStationIDs){
+    if (scratch.numStationFlags < (size_t)numStationIDs){
+        scratch.stationFlags.reset(new bool[numStationIDs]);
+        scratch.numStationFlags = numStationIDs;
+    }
+    fill(scratch.stationFlags.get(), scratch.stationFlags.get() + numStationIDs, false);
+    return scratch.stationFlags.get();
+}
+
+
+//
+// listTripsFound
+//
+// Given stationInfo struct stations array, the station nameOrder, the tripFound array indexed by station index, the number
+// of trips and their total duration in minutes, and the output stream, it outputs either none found or the trips, avg
+// duration, and the names of the stations where trips started. No return type.
+//
+void listTripsFound(const stationInfo stations[], const vector<int>& nameOrder, const bool tripFound[], int countTrips, double duration, ostream& out){
+    if(countTrips > 0){
+        out << " " << countTrips << " trips found" << endl;
+        out << " avg duration: " << floor(duration/countTrips) << " minutes" << endl;
+        
+        out << " stations where trip started: ";
+        
+        int countStations = 0; // acts as an indicator for adding comma and space if more than 1 trip exists
+        for(int i : nameOrder){
+            if(tripFound[stations[i].index] == true){
+                if(countStations >= 1){ // add comma and space for more than 1 station names
+                    out << ", ";
+                }
+                out << stations[i].name;
+                countStations++;
+            }
+        }
+        out << endl;
+        
+    } else {
+        out << "none found" << endl;
+    }
+}
+
+
+//
+// tripsInTimeSpan
+//
+// Given stationInfo struct stations array, the timeIndex over trip start times, the station nameOrder, total # of
+// station indices in the station dictionary, time1 and time2 in minutes, the queryScratch, and the output stream, it
+// outputs either none found or stations name, avg duration, and trips. No return type.
+//
+void tripsInTimeSpan(const stationInfo stations[], const timeIndex& index, const vector<int>& nameOrder, int numStationIDs, int Time1InMins, int Time2InMins, queryScratch& scratch, ostream& out){
+    int countTrips = 0;
+    double duration = 0.0;
+    
+    bool* tripFound = clearedStationFlags(scratch, numStationIDs); // start stations seen in the time span, by station index
+    
+    countTripsAndDuration(index, tripFound, Time1InMins, Time2InMins, countTrips, duration); // updates trips and duration vars
+    listTripsFound(stations, nameOrder, tripFound, countTrips, duration, out);
+    
+}
+
+
+//
+// sortTripsByStart
+//
+// Given tripColumns struct trips and total # of trips, puts the rows in startEpoch order (stable, so trips without a date
+// keep their file order at the front) if they aren't already, moving every column. Divvy's files are written in start time
+// order, so this is usually just the check. No return type.
+//
+void sortTripsByStart(tripColumns& trips, int T){
+    if (is_sorted(trips.startEpoch.begin(), trips.startEpoch.begin() + T)){
+        return;
+    }
+    
+    vector<int> order(T);
+    for (int j = 0; j < T; ++j){
+        order[j] = j;
+    }
+    stable_sort(order.begin(), order.end(), [&](int a, int b){
+        return trips.startEpoch[a] < trips.startEpoch[b];
+    });
+    
+    auto reorder = [&](auto& column){
+        vector<decay_t<decltype(column[0])>> sorted(T);
+        for (int j = 0; j < T; ++j){
+            sorted[j] = column[order[j]];
+        }
+        column.swap(sorted);
+    };
+    reorder(trips.duration);
+    reorder(trips.startMins);
+    reorder(trips.startEpoch);
+    reorder(trips.startStation);
+    reorder(trips.endStation);
+    reorder(trips.tripID);
+    reorder(trips.bikeID);
+    reorder(trips.startTime);
+}
+
+
+//
+// addTripsToPartitions
+//
+// Given tripColumns struct trips, the first row not yet partitioned, total # of trips, and the partitions by reference,
+// adds rows firstRow..T-1 to the partitions: a row joins the last partition if it's the next row, on the same day and
+// doesn't start before the partition's latest start (so a partition's rows stay in start time order), and starts a new
+// partition otherwise. No return type.
+//
+void addTripsToPartitions(const tripColumns& trips, int firstRow, int T, vector<tripPartition>& partitions){
+    for (int j = firstRow; j < T; ++j){
+        int64_t start = trips.startEpoch[j];
+        int day = (start < 0) ? -1 : (int)(start / 86400);
+        if (!partitions.empty()){
+            tripPartition& last = partitions.back();
+            if (last.end == j && last.day == day && start >= last.maxStart){
+                last.end = j + 1;
+                last.maxStart = start;
+                continue;
+            }
+        }
+        partitions.push_back({day, j, j + 1, start, start});
+    }
+}
+
+
+//
+// buildTripPartitions
+//
+// Given tripColumns struct trips, total # of trips, and the partitions by reference, cuts all the rows into partitions
+// (see addTripsToPartitions). No return type.
+//
+void buildTripPartitions(const tripColumns& trips, int T, vector<tripPartition>& partitions){
+    partitions.clear();
+    addTripsToPartitions(trips, 0, T, partitions);
+}
+
+
+//
+// rowsInDateRange
+//
+// Given tripColumns struct trips, the partitions, a date range as seconds since 1970 [from, to), and a vector of row
+// ranges by reference, adds the rows of every trip that starts in the range as [begin, end) row ranges. Partitions whose
+// [minStart, maxStart] is outside the range are skipped without touching their rows, and a partition that is only partly
+// inside is cut down with a binary search on its start times. No return type.
+//
+void rowsInDateRange(const tripColumns& trips, const vector<tripPartition>& partitions, int64_t from, int64_t to, vector<pair<int, int>>& ranges){
+    const int64_t* startEpoch = trips.startEpoch.data();
+    for (const tripPartition& partition : partitions){
+        if (partition.day < 0 || partition.maxStart < from || partition.minStart >= to){
+            continue;
+        }
+        int begin = partition.begin, end = partition.end;
+        if (partition.minStart < from){
+            begin = lower_bound(startEpoch + begin, startEpoch + end, from) - startEpoch;
+        }
+        if (partition.maxStart >= to){
+            end = lower_bound(startEpoch + begin, startEpoch + end, to) - startEpoch;
+        }
+        if (begin < end){
+            ranges.emplace_back(begin, end);
+        }
+    }
+}
+
+
+// one scan thread's share of a tripsInDateSpan: trips found, their total duration in seconds, and the start stations seen
+// (by station index)
+struct tripSpanTotals{
+    long long trips;
+    long long seconds;
+    vector<char> found;
+};
+
+
+//
+// tripsInDateSpan
+//
+// Given stationInfo struct stations array, tripColumns struct trips, the row ranges of a date range, the station
+// nameOrder, total # of station indices, time1 and time2 in minutes, the number of scan threads, the queryScratch, and the
+// output stream, scans the rows in the ranges for trips starting between time1 and time2 on any of the days (crossing
+// midnight if time1 > time2, like tripsInTimeSpan) and outputs them the same way. The rows are split across the scan
+// threads, each with its own totals and station flags, merged at the end (see parallelReduce). No return type.
+//
+void tripsInDateSpan(const stationInfo stations[], const tripColumns& trips, const vector<pair<int, int>>& ranges, const vector<int>& nameOrder, int numStationIDs, int Time1InMins, int Time2InMins, int numThreads, queryScratch& scratch, ostream& out){
+    bool crossesMidnight = Time1InMins > Time2InMins;
+    tripSpanTotals empty = {0, 0, vector<char>(numStationIDs, 0)};
+    tripSpanTotals total = parallelReduce(ranges, numThreads, empty,
+        [&](tripSpanTotals& totals, int first, int end){
+            // counted in locals so the stores into found can't make the compiler keep them in memory
+            long long chunkTrips = 0, chunkSeconds = 0;
+            char* found = totals.found.data();
+            for (int j = first; j < end; ++j){
+                int mins = trips.startMins[j];
+                bool inSpan = crossesMidnight ? (mins >= Time1InMins || mins <= Time2InMins) : (mins >= Time1InMins && mins <= Time2InMins);
+                if (mins >= 0 && inSpan){
+                    chunkTrips++;
+                    chunkSeconds += trips.duration[j];
+                    found[trips.startStation[j]] = 1;
+                }
+            }
+            totals.trips += chunkTrips;
+            totals.seconds += chunkSeconds;
+        },
+        [&](tripSpanTotals& into, const tripSpanTotals& from){
+            into.trips += from.trips;
+            into.seconds += from.seconds;
+            for (int i = 0; i < numStationIDs; ++i){
+                into.found[i] |= from.found[i];
+            }
+        });
+    
+    bool* tripFound = clearedStationFlags(scratch, numStationIDs); // start stations seen in the time span, by station index
+    for (int i = 0; i < numStationIDs; ++i){
+        tripFound[i] = total.found[i];
+    }
+    listTripsFound(stations, nameOrder, tripFound, total.trips, total.seconds / 60.0, out);
+}
+
+
+//
+// buildRouteMatrix
+//
+// Given tripColumns struct trips, total # of trips, total # of station indices, the number of threads, and a routeMatrix by
+// reference, the program splits the trips into one range per thread and (1) counts each range's trips per start station,
+// (2) scatters (end station, row) pairs into start station order (counting sort, each thread into its own slots), (3) sorts
+// each start station's pairs, counts the runs of equal end stations and notes every row's run, with threads taking start
+// stations from a shared counter, (4) packs the runs into the route arrays, and (5) buckets every trip's route id by start
+// minute. Any routes and trips added since the last build are folded in, since every row is counted again. No return type.
+//
+void buildRouteMatrix(const tripColumns& trips, int T, int numStationIDs, int numThreads, routeMatrix& routes){
+    int numWorkers = max(1, min(numThreads, T / 65536 + 1)); // no point in threads for a few trips
+    auto firstRow = [&](int w){
+        return (int)((long long)T * w / numWorkers);
+    };
+    
+    // (1)
+    vector<vector<int>> startCounts(numWorkers, vector<int>(numStationIDs, 0));
+    runOnWorkers(numWorkers, [&](int w){
+        for (int j = firstRow(w); j < firstRow(w + 1); ++j){
+            startCounts[w][trips.startStation[j]]++;
+        }
+    });
+    
+    // (2) startCounts becomes where each thread's next trip from each start station goes
+    vector<int> tripOffsets(numStationIDs + 1, 0);
+    int position = 0;
+    for (int s = 0; s < numStationIDs; ++s){
+        tripOffsets[s] = position;
+        for (int w = 0; w < numWorkers; ++w){
+            int count = startCounts[w][s];
+            startCounts[w][s] = position;
+            position += count;
+        }
+    }
+    tripOffsets[numStationIDs] = position;
+    
+    vector<uint64_t> ends(T); // end station << 32 | row
+    runOnWorkers(numWorkers, [&](int w){
+        vector<int>& next = startCounts[w];
+        for (int j = firstRow(w); j < firstRow(w + 1); ++j){
+            ends[next[trips.startStation[j]]++] = ((uint64_t)trips.endStation[j] << 32) | j;
+        }
+    });
+    
+    // (3) each start station's distinct end stations and their trips are written over the front of its slots, and every
+    // row gets the number of its route among its start station's routes
+    vector<int> runTrips(T);
+    vector<int> runOfRow(T);
+    vector<int> numRoutes(numStationIDs, 0);
+    atomic<int> nextStation(0);
+    const int stationsPerGrab = 64;
+    runOnWorkers(numWorkers, [&](int){
+        for (int first = nextStation.fetch_add(stationsPerGrab); first < numStationIDs; first = nextStation.fetch_add(stationsPerGrab)){
+            for (int s = first; s < min(first + stationsPerGrab, numStationIDs); ++s){
+                int begin = tripOffsets[s], end = tripOffsets[s + 1];
+                sort(ends.begin() + begin, ends.begin() + end);
+                int runs = 0;
+                for (int k = begin; k < end; ++k){
+                    uint32_t endStation = ends[k] >> 32;
+                    uint32_t row = (uint32_t)ends[k]; // read before a new run's end station is written over slot k
+                    if (runs == 0 || endStation != ends[begin + runs - 1]){
+                        ends[begin + runs] = endStation;
+                        runTrips[begin + runs] = 0;
+                        runs++;
+                    }
+                    runTrips[begin + runs - 1]++;
+                    runOfRow[row] = runs - 1;
+                }
+                numRoutes[s] = runs;
+            }
+        }
+    });
+    
+    // (4)
+    routes.routeOffsets.assign(numStationIDs + 1, 0);
+    for (int s = 0; s < numStationIDs; ++s){
+        routes.routeOffsets[s + 1] = routes.routeOffsets[s] + numRoutes[s];
+    }
+    routes.routeStart.resize(routes.routeOffsets[numStationIDs]);
+    routes.routeEnd.resize(routes.routeOffsets[numStationIDs]);
+    routes.routeTrips.resize(routes.routeOffsets[numStationIDs]);
+    for (int s = 0; s < numStationIDs; ++s){
+        fill(routes.routeStart.begin() + routes.routeOffsets[s], routes.routeStart.begin() + routes.routeOffsets[s + 1], s);
+        copy(ends.begin() + tripOffsets[s], ends.begin() + tripOffsets[s] + numRoutes[s], routes.routeEnd.begin() + routes.routeOffsets[s]);
+        copy(runTrips.begin() + tripOffsets[s], runTrips.begin() + tripOffsets[s] + numRoutes[s], routes.routeTrips.begin() + routes.routeOffsets[s]);
+    }
+    routes.addedRoutes.clear();
+    routes.addedFrom.clear();
+    routes.addedByMinute.clear();
+    routes.builtTrips = T;
+    routes.appendedTrips = 0;
+    
+    // (5) same counting sort as (1) and (2), by start minute
+    vector<vector<int>> minuteCounts(numWorkers, vector<int>(1440, 0));
+    runOnWorkers(numWorkers, [&](int w){
+        for (int j = firstRow(w); j < firstRow(w + 1); ++j){
+            if (trips.startMins[j] >= 0){
+                minuteCounts[w][trips.startMins[j]]++;
+            }
+        }
+    });
+    routes.minuteOffsets.assign(1441, 0);
+    position = 0;
+    for (int m = 0; m < 1440; ++m){
+        routes.minuteOffsets[m] = position;
+        for (int w = 0; w < numWorkers; ++w){
+            int count = minuteCounts[w][m];
+            minuteCounts[w][m] = position;
+            position += count;
+        }
+    }
+    routes.minuteOffsets[1440] = position;
+    
+    routes.routesByMinute.resize(position);
+    int* routesByMinute = routes.routesByMinute.ownedData();
+    runOnWorkers(numWorkers, [&](int w){
+        vector<int>& next = minuteCounts[w];
+        for (int j = firstRow(w); j < firstRow(w + 1); ++j){
+            if (trips.startMins[j] >= 0){
+                routesByMinute[next[trips.startMins[j]]++] = routes.routeOffsets[trips.startStation[j]] + runOfRow[j];
+            }
+        }
+    });
+}
+
+
+//
+// addTripsToRouteMatrix
+//
+// Given tripColumns struct trips, the first row not yet in the matrix, total # of trips, total # of station indices, and a
+// routeMatrix by reference, adds rows firstRow..T-1: each trip's route is looked up among its
+// start station's built routes with a binary search, or among the added routes, or else added, then its count goes up and
+// its route id goes into its start minute's appended bucket. The built rows aren't looked at again (see refreshRouteMatrix
+// for when the matrix is built again). No return type.
+//
+void addTripsToRouteMatrix(const tripColumns& trips, int firstRow, int T, int numStationIDs, routeMatrix& routes){
+    routes.addedFrom.resize(numStationIDs);
+    routes.addedByMinute.resize(1440);
+    int numBuiltStations = (int)routes.routeOffsets.size() - 1;
+    for (int j = firstRow; j < T; ++j){
+        int start = trips.startStation[j], end = trips.endStation[j];
+        int route = -1;
+        if (start < numBuiltStations){
+            auto first = routes.routeEnd.begin() + routes.routeOffsets[start];
+            auto last = routes.routeEnd.begin() + routes.routeOffsets[start + 1];
+            auto found = lower_bound(first, last, end);
+            if (found != last && *found == end){
+                route = found - routes.routeEnd.begin();
+            }
+        }
+        if (route < 0){
+            auto added = routes.addedRoutes.try_emplace(((uint64_t)start << 32) | (uint32_t)end, (int)routes.routeEnd.size());
+            route = added.first->second;
+            if (added.second){
+                routes.routeStart.push_back(start);
+                routes.routeEnd.push_back(end);
+                routes.routeTrips.push_back(0);
+                routes.addedFrom[start].push_back(route);
+            }
+        }
+        routes.routeTrips[route]++;
+        if (trips.startMins[j] >= 0){
+            routes.addedByMinute[trips.startMins[j]].push_back(route);
+        }
+    }
+    routes.appendedTrips += T - firstRow;
+}
+
+
+//
+// routeKey
+//
+// Given the routeMatrix and a route id, returns the route's start station << 32 | end station, which orders routes by
+// start station, then end station, whether they were built or appended.
+//
+uint64_t routeKey(const routeMatrix& routes, int route){
+    return ((uint64_t)routes.routeStart[route] << 32) | (uint32_t)routes.routeEnd[route];
+}
+
+
+//
+// rankedAbove
+//
+// Given two (count, id) pairs, returns true if a ranks above b: higher count first, then lower id.
+//
+template <typename Id>
+bool rankedAbove(const pair<int, Id>& a, const pair<int, Id>& b){
+    return a.first > b.first || (a.first == b.first && a.second < b.second);
+}
+
+
+//
+// offerTopK
+//
+// Given the best items so far as a heap of (count, id) pairs, the number of items wanted(K), and an item's count and id,
+// keeps the item if it's among the K best (see rankedAbove). The heap's top is the worst item kept, so each offer is one
+// compare unless the item gets in. No return type.
+//
+template <typename Id>
+void offerTopK(vector<pair<int, Id>>& best, size_t K, int count, Id id){
+    if (best.size() < K){
+        best.emplace_back(count, id);
+        push_heap(best.begin(), best.end(), rankedAbove<Id>);
+    } else if (K > 0 && rankedAbove(make_pair(count, id), best.front())){
+        pop_heap(best.begin(), best.end(), rankedAbove<Id>);
+        best.back() = make_pair(count, id);
+        push_heap(best.begin(), best.end(), rankedAbove<Id>);
+    }
+}
+
+
+//
+// stationLabel
+//
+// Given stationInfo struct stations array, the position of every station index in it, the station dictionary, and a
+// station index, returns "name (ID)", or just the ID for a station that is only in the trips file.
+//
+string stationLabel(const stationInfo stations[], const vector<int>& stationAt, const stationDictionary& dictionary, int index){
+    if (index >= (int)stationAt.size() || stationAt[index] < 0){ // stationAt doesn't grow when trips are appended
+        return string(dictionary.ids[index]);
+    }
+    const stationInfo& station = stations[stationAt[index]];
+    return string(station.name) + " (" + string(station.stationID) + ")";
+}
+
+
+//
+// listTopRoutes
+//
+// Given stationInfo struct stations array, the position of every station index in it, the station dictionary, the heap
+// of best routes by route key, and the output stream, outputs the routes from most to fewest trips, or none found.
+// No return type.
+//
+void listTopRoutes(const stationInfo stations[], const vector<int>& stationAt, const stationDictionary& dictionary, vector<pair<int, uint64_t>>& best, ostream& out){
+    sort_heap(best.begin(), best.end(), rankedAbove<uint64_t>); // only the K kept routes are sorted
+    
+    for (size_t r = 0; r < best.size(); ++r){
+        int start = best[r].second >> 32, end = (int)(uint32_t)best[r].second;
+        out << " " << r + 1 << ". " << stationLabel(stations, stationAt, dictionary, start) << " -> ";
+        out << stationLabel(stations, stationAt, dictionary, end) << ": " << best[r].first << " trips" << endl;
+    }
+    
+    if (best.empty()){
+        out << " none found" << endl;
+    }
+}
+
+
+//
+// topRoutesInTimeSpan
+//
+// Given the routeMatrix, time1 and time2 in minutes, the number of routes wanted(K), and the queryScratch (the best routes
+// go in its bestRoutes heap), counts the trips of every route that start between time1 and time2 (crossing midnight if
+// time1 > time2, like the trips command) from the built and appended minute buckets, touching only the trips in the span,
+// then offers each route that had any and sets its counter back to zero. No return type.
+//
+void topRoutesInTimeSpan(const routeMatrix& routes, int time1Mins, int time2Mins, size_t K, queryScratch& scratch){
+    vector<int>& tripsOnRoute = scratch.routeTrips;
+    vector<int>& touched = scratch.touched;
+    vector<pair<int, uint64_t>>& best = scratch.bestRoutes;
+    tripsOnRoute.resize(routes.routeEnd.size(), 0); // appends can add routes
+    touched.clear();
+    best.clear();
+    auto addMinutes = [&](int firstMin, int lastMin){
+        firstMin = max(firstMin, 0);
+        lastMin = min(lastMin, 1439);
+        if (firstMin > lastMin){
+            return;
+        }
+        for (int k = routes.minuteOffsets[firstMin]; k < routes.minuteOffsets[lastMin + 1]; ++k){
+            int route = routes.routesByMinute[k];
+            if (tripsOnRoute[route]++ == 0){
+                touched.push_back(route);
+            }
+        }
+        if (!routes.addedByMinute.empty()){
+            for (int m = firstMin; m <= lastMin; ++m){
+                for (int route : routes.addedByMinute[m]){
+                    if (tripsOnRoute[route]++ == 0){
+                        touched.push_back(route);
+                    }
+                }
+            }
+        }
+    };
+    
+    if (time1Mins > time2Mins){ // crosses midnight
+        addMinutes(time1Mins, 1439);
+        addMinutes(0, time2Mins);
+    } else {
+        addMinutes(time1Mins, time2Mins);
+    }
+    
+    for (int route : touched){
+        offerTopK(best, K, tripsOnRoute[route], routeKey(routes, route));
+        tripsOnRoute[route] = 0;
+    }
+}
+
+
+//
+// tripStartSeconds
+//
+// Given tripColumns struct trips and a row, returns when the trip started as seconds since 1970 if it has a date, seconds
+// into the day if it only has a time of day, or -1 if its start time was invalid.
+//
+long long tripStartSeconds(const tripColumns& trips, int row){
+    if (trips.startEpoch[row] >= 0){
+        return trips.startEpoch[row];
+    }
+    return (trips.startMins[row] < 0) ? -1 : trips.startMins[row] * 60LL;
+}
+
+
+//
+// startsBefore
+//
+// Given tripColumns struct trips and two rows, returns true if row a comes before row b in a bike's start time order: an
+// invalid start time first, then times of day, then dates, and rows with the same start in row order.
+//
+bool startsBefore(const tripColumns& trips, int a, int b){
+    bool aDated = trips.startEpoch[a] >= 0, bDated = trips.startEpoch[b] >= 0;
+    if (aDated != bDated){
+        return bDated;
+    }
+    long long aStart = tripStartSeconds(trips, a), bStart = tripStartSeconds(trips, b);
+    return (aStart != bStart) ? aStart < bStart : a < b;
+}
+
+
+//
+// resetBikeTotals
+//
+// Given a bike index and a bikeTimeline by reference, sets the bike's ride time, longest idle gap, first start, latest
+// finish, last row and last end station back to those of a bike with no trips. No return type.
+//
+void resetBikeTotals(int b, bikeTimeline& bikes){
+    bikes.rideSeconds[b] = 0;
+    bikes.longestIdle[b] = 0;
+    bikes.firstStart[b] = -1;
+    bikes.lastFinish[b] = -1;
+    bikes.lastRow[b] = -1;
+    bikes.lastEnd[b] = -1;
+}
+
+
+//
+// addTripToBike
+//
+// Given tripColumns struct trips, a row, the row's bike index, and a bikeTimeline by reference, adds the trip to the
+// bike's totals; the row must not start before the bike's last row (see startsBefore). A trip with an invalid start time
+// counts as ride time but not for the gaps, and the bike's span starts over at its first dated trip, so a gap is only
+// measured between two dated trips or two trips with only a time of day. No return type.
+//
+void addTripToBike(const tripColumns& trips, int row, int b, bikeTimeline& bikes){
+    bikes.rideSeconds[b] += trips.duration[row];
+    long long start = tripStartSeconds(trips, row);
+    if (start >= 0){
+        if (trips.startEpoch[row] >= 0 && bikes.lastRow[b] >= 0 && trips.startEpoch[bikes.lastRow[b]] < 0){
+            bikes.firstStart[b] = -1;
+            bikes.lastFinish[b] = -1;
+        }
+        if (bikes.firstStart[b] < 0){
+            bikes.firstStart[b] = start;
+        }
+        if (bikes.lastFinish[b] >= 0 && start - bikes.lastFinish[b] > bikes.longestIdle[b]){
+            bikes.longestIdle[b] = start - bikes.lastFinish[b];
+        }
+        bikes.lastFinish[b] = max(bikes.lastFinish[b], start + trips.duration[row]);
+    }
+    bikes.lastRow[b] = row;
+    bikes.lastEnd[b] = trips.endStation[row];
+}
+
+
+//
+// buildBikeTimeline
+//
+// Given tripColumns struct trips, total # of trips, total # of station indices, and a bikeTimeline by reference, the
+// program (1) interns every bike ID, (2) puts all the rows in start time order: the rows without a date by a counting sort
+// on start minute, then the dated rows, which are already in startEpoch order after sortTripsByStart, (3) stable counting
+// sorts that order by bike, so every bike's rows end up in start time order, (4) adds each bike's rows to its totals in
+// that order, and (5) groups the bikes by last end station. No return type.
+//
+void buildBikeTimeline(const tripColumns& trips, int T, int numStationIDs, bikeTimeline& bikes){
+    // (1)
+    bikes.indexOf.clear();
+    bikes.bikeIDs.clear();
+    vector<int> bikeOfRow(T);
+    for (int j = 0; j < T; ++j){
+        auto interned = bikes.indexOf.try_emplace(trips.bikeID[j], (int)bikes.bikeIDs.size());
+        if (interned.second){
+            bikes.bikeIDs.push_back(trips.bikeID[j]);
+        }
+        bikeOfRow[j] = interned.first->second;
+    }
+    int numBikes = bikes.bikeIDs.size();
+
+    // (2) the key of a row without a date is startMins + 1, so invalid times (-1) go ahead of minute 0
+    vector<int> minuteNext(1442, 0);
+    int undated = 0;
+    for (int j = 0; j < T; ++j){
+        if (trips.startEpoch[j] < 0){
+            minuteNext[trips.startMins[j] + 2]++;
+            undated++;
+        }
+    }
+    for (int m = 1; m < 1442; ++m){
+        minuteNext[m] += minuteNext[m - 1];
+    }
+    vector<int> byStart(T);
+    int dated = undated;
+    for (int j = 0; j < T; ++j){
+        if (trips.startEpoch[j] < 0){
+            byStart[minuteNext[trips.startMins[j] + 1]++] = j;
+        } else {
+            byStart[dated++] = j;
+        }
+    }
+
+    // (3)
+    bikes.bikeOffsets.assign(numBikes + 1, 0);
+    for (int j = 0; j < T; ++j){
+        bikes.bikeOffsets[bikeOfRow[j] + 1]++;
+    }
+    for (int b = 0; b < numBikes; ++b){
+        bikes.bikeOffsets[b + 1] += bikes.bikeOffsets[b];
+    }
+    vector<int> bikeNext(bikes.bikeOffsets.begin(), bikes.bikeOffsets.end() - 1);
+    bikes.bikeTrips.resize(T);
+    int* bikeTrips = bikes.bikeTrips.ownedData();
+    for (int row : byStart){
+        bikeTrips[bikeNext[bikeOfRow[row]]++] = row;
+    }
+
+    // (4)
+    bikes.addedTrips.assign(numBikes, vector<int>());
+    bikes.rideSeconds.resize(numBikes);
+    bikes.longestIdle.resize(numBikes);
+    bikes.firstStart.resize(numBikes);
+    bikes.lastFinish.resize(numBikes);
+    bikes.lastRow.resize(numBikes);
+    bikes.lastEnd.resize(numBikes);
+    for (int b = 0; b < numBikes; ++b){
+        resetBikeTotals(b, bikes);
+        for (int k = bikes.bikeOffsets[b]; k < bikes.bikeOffsets[b + 1]; ++k){
+            addTripToBike(trips, bikes.bikeTrips[k], b, bikes);
+        }
+    }
+
+    // (5)
+    groupBikesByLastEnd(numStationIDs, bikes);
+}
+
+
+//
+// addTripsToBikeTimeline
+//
+// Given tripColumns struct trips, the first row not yet in the timeline, total # of trips, total # of station indices, and
+// a bikeTimeline by reference, the program (1) interns the bike IDs of the new rows, (2) sorts just the new rows by bike
+// and start time, (3) adds each bike's new rows to its totals, or, if some start before the bike's last trip (an append
+// of earlier dates), merges them into the bike's rows and works its totals out again from its first trip, and (4) moves
+// every bike whose last end station changed to its new station's list. Bikes without new trips aren't looked at.
+// No return type.
+//
+void addTripsToBikeTimeline(const tripColumns& trips, int firstRow, int T, int numStationIDs, bikeTimeline& bikes){
+    // (1)
+    vector<pair<int, int>> added; // (bike, row)
+    added.reserve(T - firstRow);
+    for (int j = firstRow; j < T; ++j){
+        auto interned = bikes.indexOf.try_emplace(trips.bikeID[j], (int)bikes.bikeIDs.size());
+        if (interned.second){
+            bikes.bikeIDs.push_back(trips.bikeID[j]);
+        }
+        added.push_back({interned.first->second, j});
+    }
+    int numBikes = bikes.bikeIDs.size();
+    bikes.bikeOffsets.resize(numBikes + 1, bikes.bikeOffsets.empty() ? 0 : bikes.bikeOffsets.back());
+    bikes.addedTrips.resize(numBikes);
+    bikes.rideSeconds.resize(numBikes, 0);
+    bikes.longestIdle.resize(numBikes, 0);
+    bikes.firstStart.resize(numBikes, -1);
+    bikes.lastFinish.resize(numBikes, -1);
+    bikes.lastRow.resize(numBikes, -1);
+    bikes.lastEnd.resize(numBikes, -1);
+    bikes.lastAt.resize(numStationIDs);
+
+    // (2)
+    sort(added.begin(), added.end(), [&](const pair<int, int>& a, const pair<int, int>& b){
+        return (a.first != b.first) ? a.first < b.first : startsBefore(trips, a.second, b.second);
+    });
+
+    for (size_t first = 0, last; first < added.size(); first = last){
+        int b = added[first].first;
+        last = first;
+        while (last < added.size() && added[last].first == b){
+            last++;
+        }
+        int lastEnd = bikes.lastEnd[b];
+
+        // (3)
+        vector<int>& rows = bikes.addedTrips[b];
+        if (bikes.lastRow[b] < 0 || !startsBefore(trips, added[first].second, bikes.lastRow[b])){
+            for (size_t k = first; k < last; ++k){
+                rows.push_back(added[k].second);
+                addTripToBike(trips, added[k].second, b, bikes);
+            }
+        } else {
+            size_t middle = rows.size();
+            for (size_t k = first; k < last; ++k){
+                rows.push_back(added[k].second);
+            }
+            auto before = [&](int x, int y){
+                return startsBefore(trips, x, y);
+            };
+            inplace_merge(rows.begin(), rows.begin() + middle, rows.end(), before);
+            vector<int> run(bikes.bikeOffsets[b + 1] - bikes.bikeOffsets[b] + rows.size());
+            merge(bikes.bikeTrips.begin() + bikes.bikeOffsets[b], bikes.bikeTrips.begin() + bikes.bikeOffsets[b + 1],
+                  rows.begin(), rows.end(), run.begin(), before);
+            resetBikeTotals(b, bikes);
+            for (int row : run){
+                addTripToBike(trips, row, b, bikes);
+            }
+        }
+
+        // (4)
+        if (bikes.lastEnd[b] != lastEnd){
+            if (lastEnd >= 0){
+                vector<int>& old = bikes.lastAt[lastEnd];
+                old.erase(lower_bound(old.begin(), old.end(), b));
+            }
+            if (bikes.lastEnd[b] >= 0){
+                vector<int>& now = bikes.lastAt[bikes.lastEnd[b]];
+                now.insert(lower_bound(now.begin(), now.end(), b), b);
+            }
+        }
+    }
+}
+
+
+//
+// bikeReport
+//
+// Given stationInfo struct stations array, the position of every station index in it, the station dictionary, tripColumns
+// struct trips, the bikeTimeline, a bike ID, and the output stream, outputs the bike's trips, minutes ridden,
+// utilization, longest idle gap and the station its last trip ended at, or none found. Utilization is ride time as a
+// share of the time from the start of the bike's first trip to the end of its last one if its trips have dates, and of
+// the day if they only have times of day. No return type.
+//
+void bikeReport(const stationInfo stations[], const vector<int>& stationAt, const stationDictionary& dictionary, const tripColumns& trips, const bikeTimeline& bikes, const string& bikeID, ostream& out){
+    auto found = bikes.indexOf.find(bikeID);
+    if (found == bikes.indexOf.end()){
+        out << " none found" << endl;
+        return;
+    }
+    int b = found->second;
+
+    int numTrips = bikes.bikeOffsets[b + 1] - bikes.bikeOffsets[b] + bikes.addedTrips[b].size();
+    out << " bike " << bikeID << ": " << numTrips << " trips, ";
+    out << bikes.rideSeconds[b] / 60 << " minutes ridden" << endl;
+    if (trips.startEpoch[bikes.lastRow[b]] >= 0){
+        long long span = max(bikes.lastFinish[b] - bikes.firstStart[b], 1LL);
+        out << " utilization: " << round(bikes.rideSeconds[b] * 1000.0 / span) / 10 << "% of the ";
+        out << round(span / 360.0) / 10 << " hours from its first trip to the end of its last" << endl;
+    } else {
+        out << " utilization: " << round(bikes.rideSeconds[b] * 1000.0 / 86400) / 10 << "% of the day" << endl;
+    }
+    out << " longest idle gap: " << bikes.longestIdle[b] / 60 << " minutes" << endl;
+    out << " last trip ended at: " << stationLabel(stations, stationAt, dictionary, bikes.lastEnd[b]) << endl;
+}
+
+
+//
+// idleBikes
+//
+// Given stationInfo struct stations array, the position of every station index in it, the station dictionary, the
+// bikeTimeline, the number of bikes wanted(K), the queryScratch, and the output stream, outputs the K bikes with the longest idle gaps, with
+// the station each one's last trip ended at, or none found. No return type.
+//
+void idleBikes(const stationInfo stations[], const vector<int>& stationAt, const stationDictionary& dictionary, const bikeTimeline& bikes, size_t K, queryScratch& scratch, ostream& out){
+    vector<pair<int, int>>& best = scratch.best;
+    best.clear();
+    for (int b = 0; b < (int)bikes.bikeIDs.size(); ++b){
+        offerTopK(best, K, bikes.longestIdle[b], b);
+    }
+    sort_heap(best.begin(), best.end(), rankedAbove<int>);
+
+    for (size_t r = 0; r < best.size(); ++r){
+        int b = best[r].second;
+        out << " " << r + 1 << ". bike " << bikes.bikeIDs[b] << ": idle " << best[r].first / 60 << " minutes, last at ";
+        out << stationLabel(stations, stationAt, dictionary, bikes.lastEnd[b]) << endl;
+    }
+
+    if (best.empty()){
+        out << " none found" << endl;
+    }
+}
+
+
+//
+// bikesLastAt
+//
+// Given the station dictionary, the bikeTimeline, a station ID, and the output stream, outputs how many bikes ended their
+// last trip at the station and their IDs (in order of first appearance in the trips), or none found. No return type.
+//
+void bikesLastAt(const stationDictionary& dictionary, const bikeTimeline& bikes, const string& stationID, ostream& out){
+    auto found = dictionary.indexOf.find(stationID);
+    if (found == dictionary.indexOf.end() || found->second >= (int)bikes.lastAt.size() || bikes.lastAt[found->second].empty()){
+        out << " none found" << endl;
+        return;
+    }
+    const vector<int>& lastAt = bikes.lastAt[found->second];
+
+    out << " " << lastAt.size() << " bikes: ";
+    for (size_t k = 0; k < lastAt.size(); ++k){
+        if (k > 0){
+            out << ", ";
+        }
+        out << bikes.bikeIDs[lastAt[k]];
+    }
+    out << endl;
+}
+
+
+// running aggregates for streaming mode. Each chunk of trips is folded into these and then dropped, so memory depends on
+// the chunk size and the number of stations, not on the number of trips. minuteStationBits[m] is a bitset (by station
+// index) of the stations with a trip starting in minute m
+struct tripTotals{
+    int trips;
+    long long durationCounts[5]; // by durationBins
+    long long hours[24];
+    vector<long long> tripsInMinute;
+    vector<long long> secondsInMinute;
+    vector<vector<uint64_t>> minuteStationBits;
+    unordered_map<uint64_t, int> routePairs; // trips per route, keyed by start station index << 32 | end station index
+};
+
+
+//
+// foldTrips
+//
+// Given a chunk of trips as tripColumns struct trips, its number of trips(T), total # of station indices, the number of
+// threads, the tripTotals by reference, and the stationTripCounts by reference, adds the chunk to the duration and hour
+// counts, the per-minute totals and station bitsets, and the per-station trip counts. No return type.
+//
+void foldTrips(const tripColumns& trips, int T, int numStationIDs, int numThreads, tripTotals& totals, stationTripCounts& stationTrips){
+    vector<long long> durationCounts, hours;
+    countBinsInRanges(trips.duration, {{0, T}}, numThreads, durationBins(), durationCounts);
+    countBinsInRanges(trips.startMins, {{0, T}}, numThreads, hourBins(), hours);
+    for (int k = 0; k < 5; ++k){
+        totals.durationCounts[k] += durationCounts[k];
+    }
+    for (int h = 0; h < 24; ++h){
+        totals.hours[h] += hours[h];
+    }
+    totals.trips += T;
+    
+    for (int j = 0; j < T; ++j){
+        int mins = trips.startMins[j];
+        if (mins >= 0){
+            totals.tripsInMinute[mins]++;
+            totals.secondsInMinute[mins] += trips.duration[j];
+            
+            vector<uint64_t>& bits = totals.minuteStationBits[mins];
+            size_t word = trips.startStation[j] / 64;
+            if (word >= bits.size()){
+                bits.resize((numStationIDs + 63) / 64, 0);
+            }
+            bits[word] |= 1ULL << (trips.startStation[j] % 64);
+        }
+        totals.routePairs[((uint64_t)trips.startStation[j] << 32) | trips.endStation[j]]++;
+    }
+    
+    // every chunk is a fresh set of columns, so all of its rows are new to the counts
+    stationTrips.countedTrips = 0;
+    updateStationTripCounts(trips, T, numStationIDs, numThreads, stationTrips);
+}
+
+
+//
+// timeIndexFromTotals
+//
+// Given the tripTotals and a timeIndex by reference, fills in the index from the totals: the prefix sums from the
+// per-minute totals, and each minute's stations from its bitset. No return type.
+//
+void timeIndexFromTotals(const tripTotals& totals, timeIndex& index){
+    setMinuteTotals(totals.tripsInMinute, totals.secondsInMinute, index);
+    index.minuteOffsets.assign(1441, 0);
+    index.minuteStations.clear();
+    for (int m = 0; m < 1440; ++m){
+        index.minuteOffsets[m] = index.minuteStations.size();
+        const vector<uint64_t>& bits = totals.minuteStationBits[m];
+        for (size_t word = 0; word < bits.size(); ++word){
+            for (uint64_t w = bits[word]; w != 0; w &= w - 1){
+                index.minuteStations.push_back(word * 64 + __builtin_ctzll(w));
+            }
+        }
+    }
+    index.minuteOffsets[1440] = index.minuteStations.size();
+}
+
+
+//
+// buildRouteMatrixFromTotals
+//
+// Given the tripTotals, total # of station indices, and a routeMatrix by reference, builds the routes from the totals'
+// per-route trip counts (streaming mode). The trips themselves weren't kept, so there are no minute buckets. No return type.
+//
+void buildRouteMatrixFromTotals(const tripTotals& totals, int numStationIDs, routeMatrix& routes){
+    vector<pair<uint64_t, int>> pairs(totals.routePairs.begin(), totals.routePairs.end());
+    sort(pairs.begin(), pairs.end()); // by start station, then end station
+    
+    routes.routeOffsets.assign(numStationIDs + 1, 0);
+    routes.routeStart.resize(pairs.size());
+    routes.routeEnd.resize(pairs.size());
+    routes.routeTrips.resize(pairs.size());
+    for (size_t r = 0; r < pairs.size(); ++r){
+        routes.routeOffsets[(pairs[r].first >> 32) + 1]++;
+        routes.routeStart[r] = (int)(pairs[r].first >> 32);
+        routes.routeEnd[r] = (int)(pairs[r].first & 0xffffffff);
+        routes.routeTrips[r] = pairs[r].second;
+    }
+    for (int s = 0; s < numStationIDs; ++s){
+        routes.routeOffsets[s + 1] += routes.routeOffsets[s];
+    }
+    routes.minuteOffsets.clear();
+    routes.routesByMinute.clear();
+    routes.addedRoutes.clear();
+    routes.addedFrom.clear();
+    routes.addedByMinute.clear();
+    routes.builtTrips = totals.trips;
+    routes.appendedTrips = 0;
+}
+
+
+//
+// streamBikeTrips
+//
+// Given the bike trips file as a reference, the chunk size in bytes, the station dictionary, the number of parser threads,
+// the tripTotals, stationTripCounts and timeIndex by reference, and the number of bytes read by reference, the program reads
+// the file chunkBytes at a time, parses the complete lines of each chunk (see storeBikeTripValues), folds them into the
+// totals and drops them. A partial last line is carried over to the next chunk. At the end the per-station counts and the
+// time index are filled in from the totals. Returns the number of trips.
+//
+int streamBikeTrips(ifstream& inputBikeTripsFile, size_t chunkBytes, stationDictionary& dictionary, int numThreads, tripTotals& totals, stationTripCounts& stationTrips, timeIndex& index, size_t& bytesRead){
+    totals.trips = 0;
+    fill(totals.durationCounts, totals.durationCounts + 5, 0);
+    fill(totals.hours, totals.hours + 24, 0);
+    totals.tripsInMinute.assign(1440, 0);
+    totals.secondsInMinute.assign(1440, 0);
+    totals.minuteStationBits.assign(1440, vector<uint64_t>());
+    totals.routePairs.clear();
+    stationTrips.trips.assign(dictionary.ids.size(), 0);
+    bytesRead = 0;
+    
+    vector<char> buffer(chunkBytes);
+    size_t carried = 0; // bytes of an unfinished line at the front of the buffer
+    while (true){
+        inputBikeTripsFile.read(buffer.data() + carried, chunkBytes - carried);
+        size_t filled = carried + inputBikeTripsFile.gcount();
+        bool atEnd = !inputBikeTripsFile;
+        if (filled == 0){
+            break;
+        }
+        
+        // parse up to the last newline, unless this is the end of the file or the line doesn't fit in a chunk at all
+        size_t cut = filled;
+        if (!atEnd){
+            const char* lastNewline = static_cast<const char*>(memrchr(buffer.data(), '\n', filled));
+            if (lastNewline != nullptr){
+                cut = (lastNewline - buffer.data()) + 1;
+            }
+        }
+        
+        mappedFile chunk = {buffer.data(), cut, false, 0};
+        tripColumns chunkTrips;
+        int rows = storeBikeTripValues(chunk, chunkTrips, dictionary, numThreads, nullptr);
+        foldTrips(chunkTrips, rows, dictionary.ids.size(), numThreads, totals, stationTrips);
+        bytesRead += cut;
+        
+        carried = filled - cut;
+        memmove(buffer.data(), buffer.data() + cut, carried);
+        if (atEnd && carried == 0){
+            break;
+        }
+    }
+    stationTrips.trips.resize(dictionary.ids.size(), 0);
+    stationTrips.countedTrips = totals.trips;
+    
+    timeIndexFromTotals(totals, index);
+    return totals.trips;
+}
+
+
+// what the append command needs to add trips to the loaded dataset: the structures it changes (the ones divvyData points
+// to read-only), the files whose rows are in the trip columns (kept mapped, since the rows point into them), and how many
+// bytes of each trips file have been read, so appending a file that has grown parses only its new lines. Appends take
+// appending for their whole run, one at a time; commands can run during an append except while it holds dataLock
+// exclusively (nullptr when nothing runs commands during an append)
+struct tripIngest{
+    stationDictionary* dictionary;
+    tripColumns* trips;
+    stationTripCounts* stationTrips;
+    timeIndex* tripTimes;
+    routeMatrix* routes;
+    bikeTimeline* bikes;
+    vector<tripPartition>* partitions;
+    tripTotals* totals; // streaming mode only, otherwise nullptr
+    int numThreads;
+    vector<mappedFile> files;
+    unordered_map<string, size_t> bytesRead;
+    mutex appending;
+    shared_mutex* dataLock;
+};
+
+
+// trips an append has parsed but not added yet: the rows (in start time order), the part of the file they point into, the
+// station IDs they use that aren't in the dictionary yet (rows already refer to them by the index interning them in order
+// gives), and bigger copies of any trip columns without room for the rows (empty for a column that has room)
+struct pendingAppend{
+    tripColumns added;
+    int rows;
+    mappedFile file;
+    vector<string_view> newStationIDs;
+    tripColumns grown;
+};
+
+
+//
+// prepareAppend
+//
+// Given the tripIngest, a trips file name, a pendingAppend by reference, and an error message by reference, maps only the
+// bytes of the file after the ones already read from it (a file shorter than what was read is read again from the start)
+// and parses the whole lines among them (a line still being written is left for the next append). The dictionary is only
+// read, and the new rows are put in start time order; trip columns without room for them are copied into bigger ones, so
+// adding the rows doesn't have to move the old ones. Nothing the commands read is changed, so they keep running. Returns
+// false if the file can't be opened.
+//
+bool prepareAppend(tripIngest& ingest, const string& fileName, pendingAppend& pending, string& problem){
+    size_t& offset = ingest.bytesRead[fileName];
+    if (!mapInputFileFrom(fileName, offset, pending.file)){
+        problem = "unable to open input file '" + fileName + "'";
+        return false;
+    }
+    
+    const char* lastNewline = nullptr;
+    if (pending.file.size > 0){
+        lastNewline = static_cast<const char*>(memrchr(pending.file.data, '\n', pending.file.size));
+    }
+    size_t end = (lastNewline != nullptr) ? (lastNewline - pending.file.data) + 1 : 0;
+    mappedFile newLines = {pending.file.data, end, false, 0};
+    pending.rows = storeBikeTripValues(newLines, pending.added, *ingest.dictionary, ingest.numThreads, &pending.newStationIDs);
+    offset += end;
+    if (ingest.totals != nullptr || pending.rows == 0){
+        return true;
+    }
+    
+    sortTripsByStart(pending.added, pending.rows);
+    const tripColumns& trips = *ingest.trips;
+    auto makeRoom = [&](const auto& column, auto& bigger){
+        if (column.capacity() < column.size() + pending.rows){
+            bigger.reserve(max(column.size() * 2, column.size() + pending.rows));
+            bigger.append(column);
+        }
+    };
+    makeRoom(trips.duration, pending.grown.duration);
+    makeRoom(trips.startMins, pending.grown.startMins);
+    makeRoom(trips.startEpoch, pending.grown.startEpoch);
+    makeRoom(trips.startStation, pending.grown.startStation);
+    makeRoom(trips.endStation, pending.grown.endStation);
+    makeRoom(trips.tripID, pending.grown.tripID);
+    makeRoom(trips.bikeID, pending.grown.bikeID);
+    makeRoom(trips.startTime, pending.grown.startTime);
+    return true;
+}
+
+
+//
+// applyAppend
+//
+// Given the tripIngest, a prepared pendingAppend, and the number of trips loaded by reference, adds the pending trips to
+// the dataset: interns their new station IDs, swaps in any grown trip columns and adds the rows to the columns, the
+// partitions, the per-station trip counts, the time index, the route matrix and the bike timelines without redoing the
+// rows already there; in streaming mode they are folded into the totals instead. Every step costs about the number of
+// new rows (or the size of a small index), so the data lock, which the caller holds, is held briefly. No return type.
+//
+void applyAppend(tripIngest& ingest, pendingAppend& pending, int& numOfTrips){
+    for (string_view stationID : pending.newStationIDs){
+        internStation(*ingest.dictionary, stationID);
+    }
+    int numStationIDs = ingest.dictionary->ids.size();
+    int rows = pending.rows;
+    
+    if (ingest.totals != nullptr){
+        foldTrips(pending.added, rows, numStationIDs, ingest.numThreads, *ingest.totals, *ingest.stationTrips);
+        ingest.stationTrips->countedTrips = ingest.totals->trips;
+        timeIndexFromTotals(*ingest.totals, *ingest.tripTimes);
+        buildRouteMatrixFromTotals(*ingest.totals, numStationIDs, *ingest.routes);
+        unmapInputFile(pending.file); // the totals don't refer to the rows
+    } else if (rows == 0){
+        unmapInputFile(pending.file);
+    } else {
+        tripColumns& trips = *ingest.trips;
+        auto addRows = [&](auto& column, auto& bigger, const auto& from){
+            if (bigger.capacity() > 0){
+                column.swap(bigger);
+            }
+            column.append(from);
+        };
+        addRows(trips.duration, pending.grown.duration, pending.added.duration);
+        addRows(trips.startMins, pending.grown.startMins, pending.added.startMins);
+        addRows(trips.startEpoch, pending.grown.startEpoch, pending.added.startEpoch);
+        addRows(trips.startStation, pending.grown.startStation, pending.added.startStation);
+        addRows(trips.endStation, pending.grown.endStation, pending.added.endStation);
+        addRows(trips.tripID, pending.grown.tripID, pending.added.tripID);
+        addRows(trips.bikeID, pending.grown.bikeID, pending.added.bikeID);
+        addRows(trips.startTime, pending.grown.startTime, pending.added.startTime);
+        
+        addTripsToPartitions(trips, numOfTrips, numOfTrips + rows, *ingest.partitions);
+        updateStationTripCounts(trips, numOfTrips + rows, numStationIDs, ingest.numThreads, *ingest.stationTrips);
+        addTripsToTimeIndex(trips, numOfTrips, numOfTrips + rows, numStationIDs, *ingest.tripTimes);
+        addTripsToRouteMatrix(trips, numOfTrips, numOfTrips + rows, numStationIDs, *ingest.routes);
+        addTripsToBikeTimeline(trips, numOfTrips, numOfTrips + rows, numStationIDs, *ingest.bikes);
+        ingest.files.push_back(pending.file);
+    }
+    
+    numOfTrips += rows;
+}
+
+
+//
+// refreshRouteMatrix
+//
+// Given the tripIngest and total # of trips, builds the route matrix again from all the rows once the trips appended
+// since it was built pass a quarter of the trips it was built from, which keeps its appended parts small at a cost of a
+// fixed share of the trips appended. The new matrix is built on the side while commands keep reading the old one, and
+// only swapping it in takes the data lock. No return type.
+//
+void refreshRouteMatrix(tripIngest& ingest, int numOfTrips){
+    routeMatrix& routes = *ingest.routes;
+    if (ingest.totals != nullptr || routes.appendedTrips <= routes.builtTrips / 4){
+        return;
+    }
+    routeMatrix rebuilt;
+    buildRouteMatrix(*ingest.trips, numOfTrips, ingest.dictionary->ids.size(), ingest.numThreads, rebuilt);
+    
+    unique_lock<shared_mutex> lock;
+    if (ingest.dataLock != nullptr){
+        lock = unique_lock<shared_mutex>(*ingest.dataLock);
+    }
+    swap(routes, rebuilt);
+}
+
+
+// rendered output of recent commands keyed by the normalized command (see cacheKey), most recently used first, so the
+// least recently used outputs go first when the stored bytes pass maxBytes. Any change to the data (append) empties it and
+// bumps generation, so an output worked out against the old data is never stored. Shared by every thread running
+// commands, under lock
+struct resultCache{
+    mutex lock;
+    list<pair<string, string>> entries; // (key, output)
+    unordered_map<string, list<pair<string, string>>::iterator> byKey;
+    size_t bytes;
+    size_t maxBytes;
+    int precision; // decimals nearme coordinates are rounded to, -1 to use them as typed
+    uint64_t generation;
+    long long hits;
+    long long misses;
+};
+
+
+// everything the commands read. Filled in once by main before the first command and only changed after that by append,
+// which only changes it while no command is running (see tripIngest), so several commands can run against it at once
+struct divvyData{
+    const stationInfo* stations;
+    int numOfStations;
+    int numOfTrips;
+    const stationDictionary* dictionary;
+    const tripColumns* trips;
+    const vector<int>* nameOrder;
+    const stationGrid* grid;
+    const nameIndex* names;
+    const stationTripCounts* stationTrips;
+    const timeIndex* tripTimes;
+    const routeMatrix* routes;
+    const bikeTimeline* bikes;
+    const vector<tripPartition>* partitions;
+    const vector<int>* stationAt; // position in the stations array of every station index, -1 if it's only in the trips
+    const tripTotals* totals; // streaming mode only, otherwise nullptr
+    int scanThreads; // threads a command may split a scan over the trips across (see parallelReduce)
+    resultCache* cache; // nullptr if results aren't cached
+};
+
+
+// one command and its arguments, as typed by the user or read from a batch script
+struct command{
+    string name;
+    vector<string> args;
+};
+
+
+//
+// commandArgCount
+//
+// Given a command name, returns how many arguments follow it (nearme and routesbetween 3, trips and routesfrom 2, find,
+// append, routes, bike, idlebikes and lastat 1, everything else 0).
+//
+int commandArgCount(const string& name){
+    if (name == "nearme" || name == "routesbetween"){
+        return 3;
+    } else if (name == "trips" || name == "routesfrom"){
+        return 2;
+    } else if (name == "find" || name == "append" || name == "routes" || name == "bike" || name == "idlebikes" || name == "lastat"){
+        return 1;
+    }
+    return 0;
+}
+
+
+//
+// optionalArgCount
+//
+// Given a command name, returns how many optional arguments can follow its arguments: a date range for trips (2), and
+// bins and a date range for durations and starting (3); 0 for everything else.
+//
+int optionalArgCount(const string& name){
+    if (name == "durations" || name == "starting"){
+        return 3;
+    } else if (name == "trips"){
+        return 2;
+    }
+    return 0;
+}
+
+
+//
+// readCommand
+//
+// Given the input stream and a command struct by reference, reads the command name and its arguments, whitespace
+// separated like the interactive prompt. A command with optional arguments (see optionalArgCount) also takes the tokens
+// after its arguments, up to that many, if they are on the same line and start with a digit (a command name never does).
+// Returns false at the end of the input.
+//
+bool readCommand(istream& in, command& cmd){
+    cmd.args.clear();
+    if (!(in >> cmd.name)){
+        return false;
+    }
+    int numArgs = commandArgCount(cmd.name);
+    for (int k = 0; k < numArgs; ++k){
+        string arg;
+        if (!(in >> arg)){
+            return false;
+        }
+        cmd.args.push_back(arg);
+    }
+    
+    int numOptional = optionalArgCount(cmd.name);
+    for (int k = 0; k < numOptional; ++k){
+        while (in.peek() == ' ' || in.peek() == '\t'){
+            in.get();
+        }
+        int next = in.peek();
+        string arg;
+        if (next < '0' || next > '9' || !(in >> arg)){
+            break;
+        }
+        cmd.args.push_back(arg);
+    }
+    return true;
+}
+
+
+//
+// parseQueryTime
+//
+// Given a time typed by the user as hours:minutes and the minutes by reference, converts it to minutes the same way the
+// trips command always has (60 * hours + minutes). Returns false instead of throwing when a part isn't a number.
+//
+bool parseQueryTime(const string& time, int& mins){
+    try {
+        int colonIndex = time.find(":");
+        int hour = stoi(time.substr(0, colonIndex));
+        int minIndex = ++colonIndex;
+        int min = stoi(time.substr(minIndex));
+        mins = (60 * hour) + min;
+    } catch (const exception&) {
+        return false;
+    }
+    return true;
+}
+
+
+//
+// parseDouble
+//
+// Given a token and a double by reference, reads the number at the start of the token like cin would. Returns false if
+// the token doesn't start with a number.
+//
+bool parseDouble(const string& token, double& value){
+    const char* begin = token.c_str();
+    char* end = nullptr;
+    value = strtod(begin, &end);
+    return end != begin;
+}
+
+
+//
+// parseDateRange
+//
+// Given a command, the position of its first date argument, and a range by reference, reads the optional date range: one
+// date for a single day or two for the days from the first to the second, inclusive, and sets [from, to) to its seconds
+// since 1970. Returns false if a date doesn't parse or the second is before the first.
+//
+bool parseDateRange(const command& cmd, size_t first, int64_t& from, int64_t& to){
+    int firstDay, lastDay;
+    if (!parseDate(cmd.args[first], firstDay)){
+        return false;
+    }
+    lastDay = firstDay;
+    if (first + 1 < cmd.args.size() && !parseDate(cmd.args[first + 1], lastDay)){
+        return false;
+    }
+    from = (int64_t)firstDay * 86400;
+    to = ((int64_t)lastDay + 1) * 86400;
+    return lastDay >= firstDay;
+}
+
+
+//
+// cacheKey
+//
+// Given a command, the coordinate precision, and the key and the command to run by reference, makes the command's cache
+// key: its name and its arguments as the values they parse to, so "trips 7:00 9:00" and "trips 07:00 9:0", or two ways of
+// writing a date, share an entry. nearme's coordinates are rounded to the precision, if there is one, and the rounded
+// command is the one run so its output matches every command with the same key. Returns false for commands that aren't
+// cached: append, cache and profile, unknown commands, and arguments that don't parse (their output is just the invalid
+// command message).
+//
+bool cacheKey(const command& cmd, int precision, string& key, command& runAs){
+    static const char* cachedCommands[] = {"stats", "durations", "starting", "nearme", "stations", "find", "trips", "routes",
+                                           "routesfrom", "routesbetween", "bike", "idlebikes", "lastat"};
+    if (find(begin(cachedCommands), end(cachedCommands), cmd.name) == end(cachedCommands)){
+        return false;
+    }
+    
+    runAs = cmd;
+    key = cmd.name;
+    if (cmd.name == "nearme"){
+        for (size_t k = 0; k < cmd.args.size(); ++k){
+            double value;
+            if (!parseDouble(cmd.args[k], value)){
+                return false;
+            }
+            if (k < 2 && precision >= 0){
+                double scale = pow(10.0, precision);
+                value = round(value * scale) / scale;
+            }
+            char text[32];
+            snprintf(text, sizeof(text), "%.17g", value);
+            runAs.args[k] = text;
+            key += string(" ") + text;
+        }
+        return true;
+    }
+    
+    for (size_t k = 0; k < cmd.args.size(); ++k){
+        const string& arg = cmd.args[k];
+        int mins, day;
+        bool isTime = (cmd.name == "trips" || cmd.name == "routesbetween") && k < 2;
+        if (isTime && !parseQueryTime(arg, mins)){
+            return false;
+        } else if (isTime){
+            key += " t" + to_string(mins);
+        } else if ((cmd.name == "trips" || cmd.name == "durations" || cmd.name == "starting") && arg.back() != 'm'){
+            if (!parseDate(arg, day)){
+                return false;
+            }
+            key += " d" + to_string(day);
+        } else {
+            key += " " + arg;
+        }
+    }
+    return true;
+}
+
+
+//
+// cacheLookup
+//
+// Given the resultCache, a key, and the output by reference, finds the key's output and makes it the most recently used.
+// Counts a hit or a miss. Returns true if the key was found.
+//
+bool cacheLookup(resultCache& cache, const string& key, string& output){
+    lock_guard<mutex> lock(cache.lock);
+    auto found = cache.byKey.find(key);
+    if (found == cache.byKey.end()){
+        cache.misses++;
+        return false;
+    }
+    cache.hits++;
+    cache.entries.splice(cache.entries.begin(), cache.entries, found->second);
+    output = found->second->second;
+    return true;
+}
+
+
+//
+// cacheStore
+//
+// Given the resultCache, the generation the output was worked out in, a key and its output, stores the output as the most
+// recently used and drops the least recently used outputs until the cache fits in maxBytes. An output from before the
+// data last changed, or too big for the cache on its own, isn't stored. No return type.
+//
+void cacheStore(resultCache& cache, uint64_t generation, const string& key, const string& output){
+    lock_guard<mutex> lock(cache.lock);
+    size_t size = key.size() + output.size();
+    if (generation != cache.generation || size > cache.maxBytes || cache.byKey.count(key) > 0){
+        return;
+    }
+    cache.entries.emplace_front(key, output);
+    cache.byKey[key] = cache.entries.begin();
+    cache.bytes += size;
+    while (cache.bytes > cache.maxBytes){
+        pair<string, string>& last = cache.entries.back();
+        cache.bytes -= last.first.size() + last.second.size();
+        cache.byKey.erase(last.first);
+        cache.entries.pop_back();
+    }
+}
+
+
+//
+// clearResultCache
+//
+// Given the resultCache, drops every output and starts a new generation, for when the data changes. The hit and miss
+// counts are kept. No return type.
+//
+void clearResultCache(resultCache& cache){
+    lock_guard<mutex> lock(cache.lock);
+    cache.entries.clear();
+    cache.byKey.clear();
+    cache.bytes = 0;
+    cache.generation++;
+}
+
+
+//
+// cacheReport
+//
+// Given the resultCache and the output stream, outputs the number of outputs stored and their size, and the hits and
+// misses so far. No return type.
+//
+void cacheReport(resultCache& cache, ostream& out){
+    lock_guard<mutex> lock(cache.lock);
+    long long lookups = cache.hits + cache.misses;
+    out << " cache: " << cache.entries.size() << " results, " << cache.bytes / 1024 << " of " << cache.maxBytes / 1024;
+    out << " KB, " << cache.hits << " hits, " << cache.misses << " misses";
+    if (lookups > 0){
+        out << " (" << floor(1000.0 * cache.hits / lookups) / 10 << "% hits)";
+    }
+    out << endl;
+}
 
-struct tripInfo{
-    string tripID;
-    string bikeID;
-    string startStatID;
-    string endStatID;
-    int duration;
-    string startTime;
-    int startMins;
-};
+
+//
+// threadScratch
+//
+// Returns this thread's queryScratch, made the first time the thread runs a query.
+//
+queryScratch& threadScratch(){
+    thread_local queryScratch scratch;
+    return scratch;
+}
 
 
-// storeStationValues
 //
-// Given inputStationsFile as a reference, stationInfo struct stations array and number of stations,
-// the program inputs data into stationInfo struct stations array and stores in appropraite locations
-// line by line. No return type.
+// runCommand
 //
-void storeStationValues(ifstream& inputStationsFile, stationInfo stations[], int N){
-    for (int i = 0; i < N; ++i){
-        inputStationsFile >> stations[i].stationID;
-        inputStationsFile >> stations[i].capacity;
-        inputStationsFile >> stations[i].latitude;
-        inputStationsFile >> stations[i].longitude;
-        
-        string name = "";
-        getline(inputStationsFile, name);
-        name.erase(0,1); // removes the extra space at index 0
-        stations[i].name = name;
+// Given the divvyData, a command, and the output stream, runs the command and writes its output to the stream. Unknown
+// commands and arguments that can't be parsed print the invalid command message. Commands only read the data and keep
+// their working memory in this thread's queryScratch, so any number of threads can run commands at once. No return type.
+//
+void runCommand(const divvyData& data, const command& cmd, ostream& out){
+    queryScratch& scratch = threadScratch();
+    if (cmd.name == "stats") {
+        PROFILE_SCOPE(PROF_CMD_STATS);
+        quickStats(data.numOfStations, data.numOfTrips, data.stations, out);
+    } else if (cmd.name == "durations" || cmd.name == "starting") {
+        PROFILE_SCOPE(cmd.name == "durations" ? PROF_CMD_DURATIONS : PROF_CMD_STARTING);
+        // the optional arguments are bins (ending in "m") and a date range, in any order
+        bool forStarting = cmd.name == "starting";
+        string binsArg;
+        command dates;
+        for (const string& arg : cmd.args){
+            if (arg.back() == 'm' && binsArg.empty()){
+                binsArg = arg;
+            } else {
+                dates.args.push_back(arg);
+            }
+        }
+        vector<int> edges;
+        int64_t from, to;
+        if ((!binsArg.empty() && !parseBins(binsArg, forStarting, edges)) || dates.args.size() > 2 ||
+            (!dates.args.empty() && !parseDateRange(dates, 0, from, to))){
+            out << "** Invalid command, try again..." << endl;
+            return;
+        }
         
-        // initalizing these values that will be used later in program
-        stations[i].distance = 0.0;
-        stations[i].trips = 0;
-        stations[i].tripFound = false;
+        vector<long long> counts;
+        if (data.totals != nullptr){
+            // streaming mode kept the default bins and the trips per start minute, which any start time bins can be made from
+            if (!dates.args.empty()){
+                out << " date ranges aren't available in streaming mode" << endl;
+                return;
+            } else if (!binsArg.empty() && !forStarting){
+                out << " duration bins aren't available in streaming mode" << endl;
+                return;
+            } else if (!binsArg.empty()){
+                tableBins bins;
+                binsFromWidth(edges[0], 1440, bins);
+                counts.assign(bins.numBins(), 0);
+                for (int m = 0; m < 1440; ++m){
+                    counts[bins.bin(m)] += data.totals->tripsInMinute[m];
+                }
+            } else if (forStarting){
+                counts.assign(data.totals->hours, data.totals->hours + 24);
+            } else {
+                counts.assign(data.totals->durationCounts, data.totals->durationCounts + 5);
+            }
+        } else {
+            vector<pair<int, int>>& ranges = scratch.rowRanges;
+            ranges.clear();
+            if (dates.args.empty()){
+                ranges.push_back({0, data.numOfTrips});
+            } else {
+                rowsInDateRange(*data.trips, *data.partitions, from, to, ranges);
+            }
+            
+            if (binsArg.empty() && forStarting){
+                countBinsInRanges(data.trips->startMins, ranges, data.scanThreads, hourBins(), counts);
+            } else if (binsArg.empty()){
+                countBinsInRanges(data.trips->duration, ranges, data.scanThreads, durationBins(), counts);
+            } else if (forStarting){
+                tableBins bins;
+                binsFromWidth(edges[0], 1440, bins);
+                countBinsInRanges(data.trips->startMins, ranges, data.scanThreads, bins, counts);
+            } else {
+                tableBins bins;
+                binsFromEdges(edges, 60, bins); // durations are in seconds
+                countBinsInRanges(data.trips->duration, ranges, data.scanThreads, bins, counts);
+            }
+        }
         
+        if (binsArg.empty() && forStarting){
+            startingTimes(counts.data(), out);
+        } else if (binsArg.empty()){
+            durations(counts.data(), out);
+        } else if (forStarting){
+            startingTimesInBins(edges[0], counts, out);
+        } else {
+            durationsInBins(edges, counts, out);
+        }
+    } else if (cmd.name == "nearme" && cmd.args.size() == 3) {
+        PROFILE_SCOPE(PROF_CMD_NEARME);
+        double latitude, longitude, D;
+        if (!parseDouble(cmd.args[0], latitude) || !parseDouble(cmd.args[1], longitude) || !parseDouble(cmd.args[2], D)){
+            out << "** Invalid command, try again..." << endl;
+            return;
+        }
+        stationsNearMe(data.stations, *data.grid, latitude, longitude, D, scratch, out);
+    } else if (cmd.name == "stations") {
+        PROFILE_SCOPE(PROF_CMD_STATIONS);
+        listAllStations(data.stations, *data.stationTrips, *data.nameOrder, out);
+    } else if (cmd.name == "find" && cmd.args.size() == 1) {
+        PROFILE_SCOPE(PROF_CMD_FIND);
+        findStations(data.stations, *data.stationTrips, *data.nameOrder, *data.names, cmd.args[0], scratch, out);
+    } else if (cmd.name == "trips" && cmd.args.size() >= 2) {
+        PROFILE_SCOPE(PROF_CMD_TRIPS);
+        int Time1InMins, Time2InMins;
+        int64_t from, to;
+        if (!parseQueryTime(cmd.args[0], Time1InMins) || !parseQueryTime(cmd.args[1], Time2InMins) ||
+            (cmd.args.size() > 2 && !parseDateRange(cmd, 2, from, to))){
+            out << "** Invalid command, try again..." << endl;
+            return;
+        }
+        if (cmd.args.size() > 2){
+            if (data.totals != nullptr){
+                out << " date ranges aren't available in streaming mode" << endl;
+                return;
+            }
+            vector<pair<int, int>>& ranges = scratch.rowRanges;
+            ranges.clear();
+            rowsInDateRange(*data.trips, *data.partitions, from, to, ranges);
+            tripsInDateSpan(data.stations, *data.trips, ranges, *data.nameOrder, data.dictionary->ids.size(), Time1InMins, Time2InMins, data.scanThreads, scratch, out);
+            return;
+        }
+        tripsInTimeSpan(data.stations, *data.tripTimes, *data.nameOrder, data.dictionary->ids.size(), Time1InMins, Time2InMins, scratch, out);
+    } else if (cmd.name == "routes" && cmd.args.size() == 1) {
+        PROFILE_SCOPE(PROF_CMD_ROUTES);
+        int K;
+        if (!parseInt(cmd.args[0], K) || K < 1){
+            out << "** Invalid command, try again..." << endl;
+            return;
+        }
+        const routeMatrix& routes = *data.routes;
+        vector<pair<int, uint64_t>>& best = scratch.bestRoutes;
+        best.clear();
+        for (int route = 0; route < (int)routes.routeEnd.size(); ++route){
+            offerTopK(best, K, routes.routeTrips[route], routeKey(routes, route));
+        }
+        listTopRoutes(data.stations, *data.stationAt, *data.dictionary, best, out);
+    } else if (cmd.name == "routesfrom" && cmd.args.size() == 2) {
+        PROFILE_SCOPE(PROF_CMD_ROUTES);
+        int K;
+        if (!parseInt(cmd.args[1], K) || K < 1){
+            out << "** Invalid command, try again..." << endl;
+            return;
+        }
+        const routeMatrix& routes = *data.routes;
+        vector<pair<int, uint64_t>>& best = scratch.bestRoutes;
+        best.clear();
+        auto found = data.dictionary->indexOf.find(cmd.args[0]);
+        if (found != data.dictionary->indexOf.end()){
+            int start = found->second;
+            if (start + 1 < (int)routes.routeOffsets.size()){
+                for (int route = routes.routeOffsets[start]; route < routes.routeOffsets[start + 1]; ++route){
+                    offerTopK(best, K, routes.routeTrips[route], routeKey(routes, route));
+                }
+            }
+            if (start < (int)routes.addedFrom.size()){
+                for (int route : routes.addedFrom[start]){
+                    offerTopK(best, K, routes.routeTrips[route], routeKey(routes, route));
+                }
+            }
+        }
+        listTopRoutes(data.stations, *data.stationAt, *data.dictionary, best, out);
+    } else if (cmd.name == "routesbetween" && cmd.args.size() == 3) {
+        PROFILE_SCOPE(PROF_CMD_ROUTES);
+        int Time1InMins, Time2InMins, K;
+        if (!parseQueryTime(cmd.args[0], Time1InMins) || !parseQueryTime(cmd.args[1], Time2InMins) || !parseInt(cmd.args[2], K) || K < 1){
+            out << "** Invalid command, try again..." << endl;
+            return;
+        }
+        if (data.routes->minuteOffsets.empty()){
+            out << " routes by time aren't available in streaming mode" << endl;
+            return;
+        }
+        topRoutesInTimeSpan(*data.routes, Time1InMins, Time2InMins, K, scratch);
+        listTopRoutes(data.stations, *data.stationAt, *data.dictionary, scratch.bestRoutes, out);
+    } else if ((cmd.name == "bike" || cmd.name == "idlebikes" || cmd.name == "lastat") && cmd.args.size() == 1) {
+        PROFILE_SCOPE(PROF_CMD_BIKES);
+        int K = 1;
+        if (cmd.name == "idlebikes" && (!parseInt(cmd.args[0], K) || K < 1)){
+            out << "** Invalid command, try again..." << endl;
+            return;
+        }
+        if (data.totals != nullptr){
+            out << " bikes aren't available in streaming mode" << endl;
+            return;
+        }
+        if (cmd.name == "bike"){
+            bikeReport(data.stations, *data.stationAt, *data.dictionary, *data.trips, *data.bikes, cmd.args[0], out);
+        } else if (cmd.name == "idlebikes"){
+            idleBikes(data.stations, *data.stationAt, *data.dictionary, *data.bikes, K, scratch, out);
+        } else {
+            bikesLastAt(*data.dictionary, *data.bikes, cmd.args[0], out);
+        }
+    } else if (cmd.name == "cache") {
+        if (data.cache == nullptr){
+            out << " results aren't cached, run with --cache-mb N" << endl;
+        } else {
+            cacheReport(*data.cache, out);
+        }
+    } else if (cmd.name == "profile") {
+#ifdef DIVVY_PROFILE
+        profileReport(out, false);
+#else
+        out << " profiling isn't built in, rebuild with -DDIVVY_PROFILE" << endl;
+#endif
+    } else {
+        out << "** Invalid command, try again..." << endl;
     }
 }
 
 
 //
-// storeBikeTripValues
+// runCachedCommand
 //
-// Given inputBikeTripsFile as a reference, tripInfo struct trips array and number of bike trips,
-// the program inputs data into tripInfo struct trips array and stores in appropraite locations
-// line by line. No return type.
+// Given the divvyData, a command, and the output stream, writes the command's output from the result cache if it's there
+// and otherwise runs the command and stores its output (see cacheKey for what's cached). Without a cache it just runs the
+// command. No return type.
 //
-void storeBikeTripValues(ifstream& inputBikeTripsFile, tripInfo trips[], int N){
-    for (int i = 0; i < N; ++i){
-        inputBikeTripsFile >> trips[i].tripID;
-        inputBikeTripsFile >> trips[i].bikeID;
-        inputBikeTripsFile >> trips[i].startStatID;
-        inputBikeTripsFile >> trips[i].endStatID;
-        inputBikeTripsFile >> trips[i].duration;
-        inputBikeTripsFile >> trips[i].startTime;
-        
-        // initalizing startMins values that will be used later in program
-        trips[i].startMins = 0;
-        
+void runCachedCommand(const divvyData& data, const command& cmd, ostream& out){
+    string key, output;
+    command runAs;
+    if (data.cache == nullptr || !cacheKey(cmd, data.cache->precision, key, runAs)){
+        runCommand(data, cmd, out);
+        return;
+    }
+    if (cacheLookup(*data.cache, key, output)){
+        out << output;
+        return;
     }
+    
+    uint64_t generation;
+    {
+        lock_guard<mutex> lock(data.cache->lock);
+        generation = data.cache->generation;
+    }
+    ostringstream buffer;
+    runCommand(data, runAs, buffer);
+    output = buffer.str();
+    cacheStore(*data.cache, generation, key, output);
+    out << output;
 }
 
 
 //
-// quickStats
+// runAppend
 //
-// Given total number of stations(S), total number of bike trips(T), and stationInfo struct stations array,
-// the program calculates the total bike capacity by looping through the stations array and adding to the 
-// bike capacity counter. Outputs stations, trips, and total bike capacity. No return type.
-void quickStats(int S, int T, stationInfo stations[]){
-    int totalBikeCapacity = 0;
-    for (int i = 0; i < S; ++i){
-        totalBikeCapacity += stations[i].capacity;
+// Given the tripIngest, the divvyData by reference, a trips file name, and the output stream, parses the file's new trips
+// (see prepareAppend) while commands keep reading the dataset, then takes the data lock to add them (see applyAppend), to
+// update the trip count the commands see and to empty the result cache if any trips were added, outputs how many were
+// added, and rebuilds the route matrix if it's due (see refreshRouteMatrix). No return type.
+//
+void runAppend(tripIngest& ingest, divvyData& data, const string& fileName, ostream& out){
+    lock_guard<mutex> appending(ingest.appending);
+    string problem;
+    pendingAppend pending;
+    if (!prepareAppend(ingest, fileName, pending, problem)){
+        out << "**Error: " << problem << endl;
+        return;
     }
     
-    cout << " stations: " << S << endl;
-    cout << " trips: " << T << endl;
-    cout << " total bike capacity: " << totalBikeCapacity << endl;
+    int totalTrips;
+    {
+        unique_lock<shared_mutex> lock;
+        if (ingest.dataLock != nullptr){
+            lock = unique_lock<shared_mutex>(*ingest.dataLock);
+        }
+        applyAppend(ingest, pending, data.numOfTrips);
+        if (pending.rows > 0 && data.cache != nullptr){
+            clearResultCache(*data.cache);
+        }
+        totalTrips = data.numOfTrips;
+    }
+    out << " appended " << pending.rows << " trips (" << totalTrips << " total)" << endl;
     
+    refreshRouteMatrix(ingest, totalTrips);
 }
 
 
 //
-// durations
+// runBatch
 //
-// Given total number of trips(T) and tripInfo struct trips array, the program
-// loops through the trips array and categorizes trip into 5 categories based on the duration
-// (i.e oneToTwoHours or thirtyToSixtyMins) and keeps a counter. Outputs
-// the counter for the 5 categories. No return type.
+// Given the divvyData, the tripIngest, the script stream, the number of worker threads, and the output stream, reads the
+// commands up to "#" or the end of the script and runs them a window at a time: the workers take the next command of the
+// window from a shared counter and write its output into that command's own buffer, and the buffers are written out in
+// script order once the window is done. An append ends the window and runs on its own once the window is done, so every
+// command sees the dataset as of its place in the script. Output is the same as typing the commands, without the prompts.
+// Returns the number of commands.
 //
-void durations(int T, tripInfo trips[]){
-    int lessThanEqualThirtyMins = 0;
-    int thirtyToSixtyMins = 0;
-    int oneToTwoHours = 0;
-    int twoToFiveHours = 0;
-    int moreThanFiveHours = 0;
+int runBatch(divvyData& data, tripIngest& ingest, istream& script, int numThreads, ostream& out){
+    const size_t windowSize = 4096; // commands parsed and held in memory at once
+    int numCommands = 0;
     
-    for(int i = 0; i < T; ++i){
-        if(trips[i].duration <= 1800){ // <= 30 mins
-            lessThanEqualThirtyMins++;
-        } else if (trips[i].duration > 1800 && trips[i].duration <= 3600){ // 30 < duration <= 60 mins
-            thirtyToSixtyMins++;
-        } else if (trips[i].duration > 3600 && trips[i].duration <= 7200){ // 1 hour < duration <= 2 hours
-            oneToTwoHours++;
-        } else if(trips[i].duration > 7200 && trips[i].duration <= 18000){ // 2 hours < duration <= 5 hours
-            twoToFiveHours++;
-        } else if(trips[i].duration > 18000){ // duration > 5 hours
-            moreThanFiveHours++;
+    vector<command> window;
+    vector<string> results;
+    bool atEnd = false;
+    while (!atEnd){
+        window.clear();
+        command cmd;
+        bool append = false;
+        while (window.size() < windowSize){
+            if (!readCommand(script, cmd) || cmd.name == "#"){
+                atEnd = true;
+                break;
+            }
+            if (cmd.name == "append"){
+                append = true;
+                break;
+            }
+            window.push_back(cmd);
+        }
+        if (window.empty() && !append){
+            break;
+        }
+        
+        results.assign(window.size(), string());
+        atomic<size_t> next(0);
+        auto worker = [&](){
+            ostringstream buffer;
+            for (size_t c = next++; c < window.size(); c = next++){
+                buffer.str("");
+                runCachedCommand(data, window[c], buffer);
+                results[c] = buffer.str();
+            }
+        };
+        
+        int numWorkers = (int)min((size_t)numThreads, window.size());
+        vector<thread> workers;
+        for (int w = 1; w < numWorkers; ++w){
+            workers.emplace_back(worker);
+        }
+        worker(); // this thread is a worker too
+        for (thread& t : workers){
+            t.join();
+        }
+        
+        for (const string& result : results){
+            out << result;
+        }
+        numCommands += window.size();
+        
+        if (append){
+            runAppend(ingest, data, cmd.args[0], out);
+            numCommands++;
         }
+        out.flush();
     }
     
-    cout << " trips <= 30 mins: " << lessThanEqualThirtyMins << endl;
-    cout << " trips 30..60 mins: " << thirtyToSixtyMins << endl;
-    cout << " trips 1-2 hrs: " << oneToTwoHours << endl;
-    cout << " trips 2-5 hrs: " << twoToFiveHours << endl;
-    cout << " trips > 5 hrs: " << moreThanFiveHours << endl;
+    return numCommands;
 }
 
 
+// one request read from a server connection, waiting in the requestQueue for a worker. The connection's thread waits on
+// done, so a connection has at most one request in flight and gets its responses in order
+struct serverRequest{
+    int connection;
+    command cmd;
+    chrono::steady_clock::time_point received;
+    promise<void> done;
+};
+
+
+// bounded lock-free queue of requests for any number of producers and consumers (Dmitry Vyukov's bounded MPMC queue).
+// A slot's sequence says whose turn it is: equal to the position when a producer may fill it, position + 1 when a
+// consumer may take it. The number of slots is a power of two
+struct requestQueue{
+    struct slot{
+        atomic<size_t> sequence;
+        serverRequest* request;
+    };
+    unique_ptr<slot[]> slots;
+    size_t mask;
+    atomic<size_t> enqueuePos;
+    atomic<size_t> dequeuePos;
+};
+
+
+// everything the server threads share: the dataset (queries hold dataLock shared, append holds it exclusively), the
+// request queue and the way idle workers sleep, the open connections (so they can be shut down on exit), and the latency
+// of every request served
+struct queryServer{
+    divvyData* data;
+    tripIngest* ingest;
+    shared_mutex dataLock;
+    requestQueue queue;
+    atomic<int> sleepingWorkers;
+    mutex idleLock;
+    condition_variable wakeUp;
+    atomic<bool> stopping;
+    mutex connectionsLock;
+    condition_variable connectionClosed;
+    vector<int> connections;
+    mutex latencyLock;
+    vector<double> latencies; // milliseconds
+};
+
+
+atomic<bool> serverStopRequested(false); // set by SIGINT and SIGTERM
+
+
 //
-// startingTimes
+// initRequestQueue
 //
-// Given total number of trips(T) and tripInfo struct trips array, the program loops through the startTime string 
-// and finds the hour. It categorizes into 1 of 24 categories and executes if-elseif statement to count how many 
-// they are in each hour category. No return type.
-//
-void startingTimes(int T, tripInfo trips[]){
-    // initializing count for 24 hours(0-23)
-    int Hour0, Hour1, Hour2, Hour3, Hour4, Hour5, Hour6, Hour7, Hour8, Hour9, Hour10, Hour11, Hour12, Hour13, Hour14;
-    int Hour15, Hour16, Hour17, Hour18, Hour19, Hour20, Hour21, Hour22, Hour23;
-
-    //setting to 0
-    Hour0 = Hour1 = Hour2 = Hour3 = Hour4 = Hour5 = Hour6 = Hour7 = Hour8 = Hour9 = Hour10 = Hour11 = Hour12 = Hour13 = Hour14 = 0;
-    Hour15 = Hour16 = Hour17 = Hour18 = Hour19 = Hour20 = Hour21 = Hour22 = Hour23 = 0;
-
-    for(int i = 0; i < T; ++i){
-        string startTime = trips[i].startTime;
-        int colonIndex = startTime.find(":");
-        int hour = stoi(startTime.substr(0, colonIndex)); // convert the substring from index 0 til colonIndex to int
-        
-        if(hour == 0){
-            Hour0++;
-        } else if (hour == 1){
-            Hour1++;
-        } else if (hour == 2){
-            Hour2++;
-        } else if (hour == 3){
-            Hour3++;
-        } else if (hour == 4){
-            Hour4++;
-        } else if (hour == 5){
-            Hour5++;
-        } else if (hour == 6){
-            Hour6++;
-        } else if (hour == 7){
-            Hour7++;
-        } else if (hour == 8){
-            Hour8++;
-        } else if (hour == 9){
-            Hour9++;
-        } else if (hour == 10){
-            Hour10++;
-        } else if (hour == 11){
-            Hour11++;
-        } else if (hour == 12){
-            Hour12++;
-        } else if (hour == 13){
-            Hour13++;
-        } else if (hour == 14){
-            Hour14++;
-        } else if (hour == 15){
-            Hour15++;
-        } else if (hour == 16){
-            Hour16++;
-        } else if (hour == 17){
-            Hour17++;
-        } else if (hour == 18){
-            Hour18++;
-        } else if (hour == 19){
-            Hour19++;
-        } else if (hour == 20){
-            Hour20++;
-        } else if (hour == 21){
-            Hour21++;
-        } else if (hour == 22){
-            Hour22++;
-        } else if (hour == 23){
-            Hour23++;
-        }
+// Given a requestQueue by reference and a number of slots (a power of two), makes the queue empty. No return type.
+//
+void initRequestQueue(requestQueue& queue, size_t numSlots){
+    queue.slots.reset(new requestQueue::slot[numSlots]);
+    for (size_t i = 0; i < numSlots; ++i){
+        queue.slots[i].sequence.store(i, memory_order_relaxed);
+        queue.slots[i].request = nullptr;
     }
-    // output results
-    cout << " 0: " << Hour0 << endl;
-    cout << " 1: " << Hour1 << endl;
-    cout << " 2: " << Hour2 << endl;
-    cout << " 3: " << Hour3 << endl;
-    cout << " 4: " << Hour4 << endl;
-    cout << " 5: " << Hour5 << endl;
-    cout << " 6: " << Hour6 << endl;
-    cout << " 7: " << Hour7 << endl;
-    cout << " 8: " << Hour8 << endl;
-    cout << " 9: " << Hour9 << endl;
-    cout << " 10: " << Hour10 << endl;
-    cout << " 11: " << Hour11 << endl;
-    cout << " 12: " << Hour12 << endl;
-    cout << " 13: " << Hour13 << endl;
-    cout << " 14: " << Hour14 << endl;
-    cout << " 15: " << Hour15 << endl;
-    cout << " 16: " << Hour16 << endl;
-    cout << " 17: " << Hour17 << endl;
-    cout << " 18: " << Hour18 << endl;
-    cout << " 19: " << Hour19 << endl;
-    cout << " 20: " << Hour20 << endl;
-    cout << " 21: " << Hour21 << endl;
-    cout << " 22: " << Hour22 << endl;
-    cout << " 23: " << Hour23 << endl;
-}
-
-
-//
-// swapValues
-//
-// Given struct stationInfo a and b by reference, the program swaps the elements by using 
-// a temporary variable to store one of the elements. No return type.
-//
-void swapValues(stationInfo& a, stationInfo& b){
-    stationInfo tempA = a;
-    a = b;
-    b = tempA;
+    queue.mask = numSlots - 1;
+    queue.enqueuePos.store(0, memory_order_relaxed);
+    queue.dequeuePos.store(0, memory_order_relaxed);
 }
 
 
-// 
-// bubbleSortByDistance
 //
-// Given stationInfo struct stations array and total number of stations(S), bubble sort is performed
-// by distance from nearest to farthest, which is an ascending order. The program does a while loop and for loop to 
-// swap elements of the stations array and store if there was a swap so the while loop can execute again.
+// pushRequest
 //
-void bubbleSortByDistance(stationInfo stations[], int S){
-    bool isSwapped = true; // initial value to start the bubble sort
-    while(isSwapped){
-        isSwapped = false;
-        for(int i = 0; i < (S - 1); ++i){
-            if(stations[i].distance > stations[i+1].distance){
-                swapValues(stations[i], stations[i+1]); // swap 2 index from array
-                isSwapped = true; // allows while loop to execute again since there was a swap detected
+// Given the requestQueue and a request, adds the request at the back of the queue. Returns false if the queue is full.
+//
+bool pushRequest(requestQueue& queue, serverRequest* request){
+    size_t pos = queue.enqueuePos.load(memory_order_relaxed);
+    while (true){
+        requestQueue::slot& cell = queue.slots[pos & queue.mask];
+        size_t sequence = cell.sequence.load(memory_order_acquire);
+        intptr_t diff = (intptr_t)sequence - (intptr_t)pos;
+        if (diff == 0){
+            if (queue.enqueuePos.compare_exchange_weak(pos, pos + 1, memory_order_relaxed)){
+                cell.request = request;
+                cell.sequence.store(pos + 1, memory_order_release);
+                return true;
             }
+        } else if (diff < 0){
+            return false;
+        } else {
+            pos = queue.enqueuePos.load(memory_order_relaxed); // another producer took this slot
         }
     }
 }
 
 
 //
-// distBetween2Points
+// popRequest
 //
-// Returns the distance in miles between 2 points (lat1, long1) and 
-// (lat2, long2).  Latitudes are positive above the equator and 
-// negative below; longitudes are positive heading east of Greenwich 
-// and negative heading west.  Example: Chicago is (41.88, -87.63).
-//
-// NOTE: you may get slightly different results depending on which 
-// (lat, long) pair is passed as the first parameter.
-// 
-// Originally written by: Prof. Hummel, U. of Illinois, Chicago, Spring 2021
-// Reference: http://www8.nau.edu/cvm/latlon_formula.html
+// Given the requestQueue and a request pointer by reference, takes the request at the front of the queue. Returns false
+// if the queue is empty.
 //
-double distBetween2Points(double lat1, double long1, double lat2, double long2)
-{
-  double PI = 3.14159265;
-  double earth_rad = 3963.1;  // statue miles:
-
-  double lat1_rad = lat1 * PI / 180.0;
-  double long1_rad = long1 * PI / 180.0;
-  double lat2_rad = lat2 * PI / 180.0;
-  double long2_rad = long2 * PI / 180.0;
-
-  double dist = earth_rad * acos(
-    (cos(lat1_rad) * cos(long1_rad) * cos(lat2_rad) * cos(long2_rad))
-    +
-    (cos(lat1_rad) * sin(long1_rad) * cos(lat2_rad) * sin(long2_rad))
-    +
-    (sin(lat1_rad) * sin(lat2_rad))
-  );
-
-  return dist;
+bool popRequest(requestQueue& queue, serverRequest*& request){
+    size_t pos = queue.dequeuePos.load(memory_order_relaxed);
+    while (true){
+        requestQueue::slot& cell = queue.slots[pos & queue.mask];
+        size_t sequence = cell.sequence.load(memory_order_acquire);
+        intptr_t diff = (intptr_t)sequence - (intptr_t)(pos + 1);
+        if (diff == 0){
+            if (queue.dequeuePos.compare_exchange_weak(pos, pos + 1, memory_order_relaxed)){
+                request = cell.request;
+                cell.sequence.store(pos + queue.mask + 1, memory_order_release);
+                return true;
+            }
+        } else if (diff < 0){
+            return false;
+        } else {
+            pos = queue.dequeuePos.load(memory_order_relaxed); // another consumer took this slot
+        }
+    }
 }
 
 
 //
-// stationsNearMe
+// sendAll
 //
-// Given stationInfo struct stations array and total number of stations(S), it gets user inputs and calulates distance
-// and stores in stations array. It sorts the stations array by distance by calling bubble sort function. 
-// It loops through the distances for all stations and checks if it's within the D to output it. No return type.
+// Given a socket and some bytes, writes all of them. Returns false if the connection is gone.
 //
-void stationsNearMe(stationInfo stations[], int S){
-    // get user input of lat, long, and D
-    double latitude, longitude, D;
-    
-    cin >> latitude;
-    cin >> longitude;
-    cin >> D;
-    
-    // store the distance in the stations array
-    for(int i = 0; i < S; ++i){
-        stations[i].distance = distBetween2Points(latitude, longitude, stations[i].latitude, stations[i].longitude);
-    }
-    
-    bubbleSortByDistance(stations, S);
-     
-    cout << " The following stations are within " << D << " miles of (" << latitude << ", " << longitude << "):" << endl;
-    int foundOneStation = 0; // to check if atleast one station is within D
-    
-    for(int i = 0; i < S; ++i){
-        if(stations[i].distance <= D){
-            foundOneStation = 1;
-            cout << " station " << stations[i].stationID << " (" << stations[i].name << "): " << stations[i].distance << " miles" << endl;
+bool sendAll(int connection, const char* data, size_t size){
+    while (size > 0){
+        ssize_t sent = send(connection, data, size, MSG_NOSIGNAL);
+        if (sent < 0 && errno == EINTR){
+            continue;
         }
+        if (sent <= 0){
+            return false;
+        }
+        data += sent;
+        size -= sent;
     }
-    
-    if(foundOneStation == 0){
-        cout << " none found" << endl;
-    }
+    return true;
 }
 
 
 //
-// storeTrips
+// serveRequest
 //
-// Given stationInfo struct stations array, tripInfo struct trips array, total number of stations, and total number of trips,
-// the program loops through items in stations and checks if trips value is 0. If it's 0, then it loops through the trips to find
-// if it matches with start and/or end station id and increases trips counter. No return type.
+// Given the queryServer and a request, runs the command (a query alongside the other workers under the shared data lock,
+// an append taking the lock exclusively only to add the trips it has parsed) and writes the response to the request's
+// connection: a header line with the output's size in bytes and the request's latency in microseconds (from when it was
+// read to when its output was ready), then the output, exactly what the command prints at the prompt. No return type.
 //
-void storeTrips(stationInfo stations[], tripInfo trips[], int S, int T){
-    for(int i = 0; i < S; ++i){
-        if(stations[i].trips == 0){ // only adding # of trips when trip is empty
-            for(int k = 0; k < T; ++k){
-                if(trips[k].startStatID == stations[i].stationID && trips[k].endStatID == stations[i].stationID){
-                    stations[i].trips += 1; // only increasing trip by 1 for same start and end station id
-                } else if (trips[k].startStatID == stations[i].stationID){
-                    stations[i].trips += 1;
-                } else if (trips[k].endStatID == stations[i].stationID){
-                    stations[i].trips += 1;
-                }
-            }
-        }
+void serveRequest(queryServer& server, serverRequest& request){
+    ostringstream output;
+    if (request.cmd.name == "append" && request.cmd.args.size() == 1){
+        runAppend(*server.ingest, *server.data, request.cmd.args[0], output); // takes the data lock when it needs to
+    } else {
+        shared_lock<shared_mutex> lock(server.dataLock);
+        runCachedCommand(*server.data, request.cmd, output);
+    }
+    chrono::duration<double, micro> latency = chrono::steady_clock::now() - request.received;
+    
+    string body = output.str();
+    string header = to_string(body.size()) + " " + to_string((long long)latency.count()) + "\n";
+    if (sendAll(request.connection, header.data(), header.size())){
+        sendAll(request.connection, body.data(), body.size());
+    }
+    {
+        lock_guard<mutex> lock(server.latencyLock);
+        server.latencies.push_back(latency.count() / 1000.0);
     }
+    request.done.set_value();
 }
 
 
-// 
-// bubbleSortByName
 //
-// Given stationInfo struct stations array and total number of stations(S), bubble sort is performed
-// alphabetically, which is done in an ascending order. The program does a while loop and for loop to 
-// swap elements of the stations array and store if there was a swap so the while loop can execute again.
+// serverWorker
 //
-void bubbleSortByName(stationInfo stations[], int S){
-    bool isSwapped = true; // initial value to start the bubble sort
-    while(isSwapped){
-        isSwapped = false;
-        for(int i = 0; i < (S - 1); ++i){
-            if(stations[i].name > stations[i+1].name){
-                swapValues(stations[i], stations[i+1]); // swap 2 index from array
-                isSwapped = true; // allows while loop to execute again since there was a swap detected
-            }
+// Given the queryServer, takes requests off the queue and serves them until the server is stopping and the queue is
+// empty. An idle worker sleeps on wakeUp; it counts itself in sleepingWorkers and looks at the queue once more before
+// sleeping, and producers look at sleepingWorkers after pushing, so a request can't slip in unnoticed. No return type.
+//
+void serverWorker(queryServer& server){
+    serverRequest* request;
+    while (true){
+        if (popRequest(server.queue, request)){
+            serveRequest(server, *request);
+            continue;
+        }
+        if (server.stopping.load()){
+            return;
         }
+        
+        unique_lock<mutex> lock(server.idleLock);
+        server.sleepingWorkers.fetch_add(1);
+        atomic_thread_fence(memory_order_seq_cst);
+        if (popRequest(server.queue, request)){
+            server.sleepingWorkers.fetch_sub(1);
+            lock.unlock();
+            serveRequest(server, *request);
+            continue;
+        }
+        server.wakeUp.wait_for(lock, chrono::milliseconds(100));
+        server.sleepingWorkers.fetch_sub(1);
     }
 }
 
 
 //
-// listAllStations
+// submitRequest
 //
-// Given stationInfo struct stations array, tripInfo struct trips array, total number of stations(S), and total number of trips(T),
-// calls the function storeTrips and bubbleSortByName to update the stations array. Outputs all the stations. No return type.
+// Given the queryServer and a request, puts the request on the queue (waiting for room if it's full) and wakes a worker
+// if any are asleep. No return type.
 //
-void listAllStations(stationInfo stations[], tripInfo trips[], int S, int T){
-    storeTrips(stations, trips, S, T);
-    
-    bubbleSortByName(stations, S);
-    
-    // output the stations
-    for(int i = 0; i < S; ++i){
-        cout << stations[i].name << " (" << stations[i].stationID << ") @ ("<< stations[i].latitude << ", ";
-        cout << stations[i].longitude << "), " << stations[i].capacity << " capacity, " << stations[i].trips << " trips" << endl;
+void submitRequest(queryServer& server, serverRequest* request){
+    while (!pushRequest(server.queue, request)){
+        this_thread::yield();
+    }
+    atomic_thread_fence(memory_order_seq_cst);
+    if (server.sleepingWorkers.load() > 0){
+        lock_guard<mutex> lock(server.idleLock);
+        server.wakeUp.notify_one();
     }
-  
 }
 
 
 //
-// searchTargetInStations
+// serveConnection
 //
-// Given stationInfo struct stations array, total number of stations(S), and a string targer, the program searches through the
-// the names of stations array to find target. If it does, it increases the namesMatchCounter by 1. Returns namesMatchCounter.
+// Given the queryServer and a connected socket, reads commands one line at a time (one command per line, the same
+// language as the prompt), hands each to the workers and waits for its response before reading the next. Blank lines are
+// skipped, "#" or the end of the connection closes it, and a line over 64 KB drops the connection. No return type.
 //
-int searchTargetInStations(stationInfo stations[], int S, string target){
-    int namesMatchCounter = 0;
-    string stationName; 
-    size_t stationExistsInName;
-    
-    for(int i = 0; i < S; ++i){
-        stationName = stations[i].name;
-        stationExistsInName = stationName.find(target);
+void serveConnection(queryServer& server, int connection){
+    const size_t maxLineBytes = 1 << 16;
+    string pending;
+    char buffer[4096];
+    bool open = true;
+    while (open){
+        size_t newline;
+        while (open && (newline = pending.find('\n')) == string::npos){
+            ssize_t got = recv(connection, buffer, sizeof(buffer), 0);
+            if (got < 0 && errno == EINTR){
+                continue;
+            }
+            if (got <= 0 || pending.size() > maxLineBytes){
+                open = false;
+            } else {
+                pending.append(buffer, got);
+            }
+        }
+        if (!open){
+            break;
+        }
+        istringstream line(pending.substr(0, newline));
+        pending.erase(0, newline + 1);
         
-        if(stationExistsInName != string::npos){ // target exists in the name
-            namesMatchCounter++;
+        serverRequest request;
+        request.connection = connection;
+        request.received = chrono::steady_clock::now();
+        if (!readCommand(line, request.cmd) && request.cmd.name.empty()){
+            continue; // blank line
+        }
+        if (request.cmd.name == "#"){
+            break;
         }
+        future<void> done = request.done.get_future();
+        submitRequest(server, &request);
+        done.wait();
     }
     
-    return namesMatchCounter;
+    lock_guard<mutex> lock(server.connectionsLock); // closed under the lock so the number isn't reused while still listed
+    server.connections.erase(find(server.connections.begin(), server.connections.end(), connection));
+    close(connection);
+    server.connectionClosed.notify_all();
 }
 
 
 //
-// keyExists
+// openServerSocket
 //
-// Given an int index, stationInfo struct stations array, and a string target,
-// the program performs if condition to see if the target exists in the specific name of the station by index value given.
-// If it does, returns 1. If it doesn't, returns 0.
+// Given a Unix socket path (or empty), a loopback TCP port (used if the path is empty), and an error message by
+// reference, creates the listening socket. A stale socket file left at the path by an earlier server is replaced, any
+// other file there is left alone. Returns the socket, or -1 with the error message set.
 //
-int keyExists(int index, stationInfo stations[], string target){
-    string stationName = stations[index].name;
-    size_t stationExistsInName = stationName.find(target);
-    
-    if(stationExistsInName != string::npos){ // target exists in the name
-            return 1; // found
+int openServerSocket(const string& unixPath, int tcpPort, string& problem){
+    int listener;
+    if (!unixPath.empty()){
+        sockaddr_un address;
+        memset(&address, 0, sizeof(address));
+        address.sun_family = AF_UNIX;
+        if (unixPath.size() >= sizeof(address.sun_path)){
+            problem = "socket path '" + unixPath + "' is too long";
+            return -1;
+        }
+        strcpy(address.sun_path, unixPath.c_str());
+        
+        struct stat existing;
+        if (lstat(unixPath.c_str(), &existing) == 0 && S_ISSOCK(existing.st_mode)){
+            unlink(unixPath.c_str());
+        }
+        listener = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (listener < 0 || bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0){
+            problem = "unable to listen on '" + unixPath + "': " + strerror(errno);
+            if (listener >= 0){
+                close(listener);
+            }
+            return -1;
+        }
+    } else {
+        sockaddr_in address;
+        memset(&address, 0, sizeof(address));
+        address.sin_family = AF_INET;
+        address.sin_port = htons(tcpPort);
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK); // local dashboards only, never other machines
+        
+        listener = socket(AF_INET, SOCK_STREAM, 0);
+        int reuse = 1;
+        if (listener >= 0){
+            setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+        }
+        if (listener < 0 || bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0){
+            problem = "unable to listen on 127.0.0.1:" + to_string(tcpPort) + ": " + strerror(errno);
+            if (listener >= 0){
+                close(listener);
+            }
+            return -1;
         }
+    }
     
-    return 0; // not found for specific index
+    if (listen(listener, 64) != 0){
+        problem = string("unable to listen: ") + strerror(errno);
+        close(listener);
+        return -1;
+    }
+    return listener;
 }
 
 
 //
-// findStations
+// runServer
 //
-// Given stationInfo struct stations array, tripInfo struct trips array, total number of stations, and total number of trips,
-// the program does bubbleSortByName and storeTrips to update the stations array. It then loops through the stations array to
-// find if the targetKey string exists in station name. It then outputs either none found or the station info. No return type.
+// Given the divvyData, the tripIngest, a Unix socket path or a loopback TCP port, and the number of worker threads, serves
+// the dataset until SIGINT or SIGTERM: every connection gets a thread that reads its requests, and a fixed pool of workers
+// takes them from the lock-free queue and runs them against the one shared copy of the data. On the way out the
+// connections are closed, the workers finish what is queued, and the number of requests with their median, p99 and max
+// latency (and the result cache's hits and misses) goes to cerr. Returns the exit code.
 //
-void findStations(stationInfo stations[], tripInfo trips[], int S, int T){
-    string targetKey;
+int runServer(divvyData& data, tripIngest& ingest, const string& unixPath, int tcpPort, int numThreads){
+    string problem;
+    int listener = openServerSocket(unixPath, tcpPort, problem);
+    if (listener < 0){
+        cerr << "**Error: " << problem << endl;
+        return 1;
+    }
     
-    cin >> targetKey;
+    struct sigaction stopAction;
+    memset(&stopAction, 0, sizeof(stopAction));
+    stopAction.sa_handler = [](int){ serverStopRequested.store(true); };
+    sigaction(SIGINT, &stopAction, nullptr); // no SA_RESTART, so poll returns when a signal arrives
+    sigaction(SIGTERM, &stopAction, nullptr);
     
-    bubbleSortByName(stations, S);
+    queryServer server;
+    server.data = &data;
+    server.ingest = &ingest;
+    ingest.dataLock = &server.dataLock;
+    initRequestQueue(server.queue, 1024);
+    server.sleepingWorkers.store(0);
+    server.stopping.store(false);
     
-    storeTrips(stations, trips, S, T);
+    vector<thread> workers;
+    for (int w = 0; w < numThreads; ++w){
+        workers.emplace_back(serverWorker, ref(server));
+    }
+    cerr << " serving on " << (unixPath.empty() ? "127.0.0.1:" + to_string(tcpPort) : unixPath) << " with " << numThreads;
+    cerr << " workers" << endl;
     
-    for(int i = 0; i < S; ++i){
-        int exists = keyExists(i, stations, targetKey);
-        if(exists == 1){
-            cout << stations[i].name << " (" << stations[i].stationID << ") @ ("<< stations[i].latitude << ", ";
-            cout << stations[i].longitude << "), " << stations[i].capacity << " capacity, " << stations[i].trips << " trips" << endl;
+    while (!serverStopRequested.load()){
+        pollfd waiting = {listener, POLLIN, 0};
+        if (poll(&waiting, 1, 500) <= 0){ // the timeout rechecks the stop flag
+            continue;
+        }
+        int connection = accept(listener, nullptr, nullptr);
+        if (connection < 0){
+            continue;
         }
+        lock_guard<mutex> lock(server.connectionsLock);
+        server.connections.push_back(connection);
+        thread(serveConnection, ref(server), connection).detach();
     }
     
-    // checking if no match found
-    int stationFound = searchTargetInStations(stations, S, targetKey);
-    if(stationFound == 0){ // no station contain targetKey string
-        cout << " none found" << endl;
+    close(listener);
+    if (!unixPath.empty()){
+        unlink(unixPath.c_str());
+    }
+    {
+        unique_lock<mutex> lock(server.connectionsLock);
+        for (int connection : server.connections){
+            shutdown(connection, SHUT_RD); // a reader blocked in recv sees the end of the connection
+        }
+        server.connectionClosed.wait(lock, [&](){ return server.connections.empty(); });
+    }
+    server.stopping.store(true);
+    {
+        lock_guard<mutex> lock(server.idleLock);
+        server.wakeUp.notify_all();
+    }
+    for (thread& worker : workers){
+        worker.join();
+    }
+    
+    vector<double>& millis = server.latencies;
+    sort(millis.begin(), millis.end());
+    cerr << " served " << millis.size() << " requests";
+    if (!millis.empty()){
+        cerr << ", latency median " << millis[millis.size() / 2] << " ms, p99 " << millis[(size_t)ceil(0.99 * millis.size()) - 1];
+        cerr << " ms, max " << millis.back() << " ms";
+    }
+    cerr << endl;
+    if (data.cache != nullptr){
+        cacheReport(*data.cache, cerr);
     }
+    ingest.dataLock = nullptr;
+    return 0;
 }
 
 
+// what main measured while loading, reported at the top of the benchmark
+struct loadTimings{
+    size_t bytes;
+    double loadSeconds; // parsing the trips (or mapping the snapshot)
+    double indexSeconds; // building the name order, name index, grid, partitions, trip counts, time index, routes and bike timelines
+    int numThreads;
+};
+
+
 //
-// tripFoundAtStation
+// benchmarkCommands
 //
-// Given stationInfo struct stations array, string targetStationID, and total number of stations(S),
-// the program stores either true or false values in tripFound inside stations array if it matches the targetStationID. No return type.
+// Given the divvyData, the number of runs of each command, and a vector of (label, commands) by reference, makes the
+// commands to time: stats, durations, starting and stations as is, and nearme, find and trips with arguments picked at
+// random (fixed seed) from the loaded stations: nearme around a station with a radius of 0.25 to 2 miles, find with a
+// 3 to 5 letter piece of a station name, and trips over a 15 minute to 3 hour window; then routes 10 and idlebikes 10.
+// No return type.
 //
-void tripFoundAtStation(stationInfo stations[], string targetStationID, int S){
-    for (int i = 0; i < S; ++i){
-        if(stations[i].stationID == targetStationID){
-            stations[i].tripFound = true;
-        }
+void benchmarkCommands(const divvyData& data, int runs, vector<pair<string, vector<command>>>& suites){
+    mt19937 engine(2021);
+    auto makeCommand = [](const string& name, const vector<string>& args){
+        command cmd;
+        cmd.name = name;
+        cmd.args = args;
+        return cmd;
+    };
+    
+    const char* plain[4] = {"stats", "durations", "starting", "stations"};
+    for (const char* name : plain){
+        suites.emplace_back(name, vector<command>(runs, makeCommand(name, {})));
+    }
+    
+    vector<command> nearme, find, trips;
+    const double radius[4] = {0.25, 0.5, 1.0, 2.0};
+    for (int r = 0; r < runs && data.numOfStations > 0; ++r){
+        const stationInfo& station = data.stations[engine() % data.numOfStations];
+        nearme.push_back(makeCommand("nearme", {to_string(station.latitude), to_string(station.longitude), to_string(radius[engine() % 4])}));
+        
+        string word(data.stations[engine() % data.numOfStations].name);
+        word = word.substr(0, word.find(' ')); // find takes one word
+        size_t length = min(word.size(), (size_t)(3 + engine() % 3));
+        size_t start = engine() % (word.size() - length + 1);
+        find.push_back(makeCommand("find", {word.substr(start, length)}));
     }
+    for (int r = 0; r < runs; ++r){
+        int first = engine() % 1440;
+        int last = (first + 15 + engine() % 166) % 1440;
+        trips.push_back(makeCommand("trips", {to_string(first / 60) + ":" + to_string(first % 60), to_string(last / 60) + ":" + to_string(last % 60)}));
+    }
+    suites.emplace_back("nearme", nearme);
+    suites.emplace_back("find", find);
+    suites.emplace_back("trips", trips);
+    suites.emplace_back("routes", vector<command>(runs, makeCommand("routes", {"10"})));
+    suites.emplace_back("idlebikes", vector<command>(runs, makeCommand("idlebikes", {"10"})));
 }
 
 
 //
-// countTripsAndDuration
+// runBenchmark
 //
-// Given stationInfo struct stations array, tripInfo struct trips array, total # of stations, total # of trips, time1Mins,
-// time2Mins, trips by refernce, and duration by reference, it loops through the trips array elements and examines two cases.
-// If it crosses midnight(time1Mins > time2Mins), checks if startTime is between time1 and 23:59 and 0:00 and time2. 
-// Else, it sees if startMins is between time1 and time2. Updates trips and duration accordingly. No return type.
+// Given the divvyData, the loadTimings, the number of runs of each command, and the output stream, times every run of the
+// benchmarkCommands on this thread (rendering into a buffer that is thrown away) and writes a JSON report: dataset size,
+// load and index build times and throughput, and for every command the median and p99 latency in milliseconds and the
+// number of runs per second. No return type.
 //
-void countTripsAndDuration(stationInfo stations[], tripInfo trips[], int S, int T, int time1Mins, int time2Mins, int& countTrips, double& totalDuration){
-    for(int j = 0; j < T; ++j){
-        if(time1Mins > time2Mins){ // crosses midnight
-            // looks for trip's startTime between time1Mins and 23:59 OR startTime between 0:00(0 mins) to time2Mins
-            if((trips[j].startMins >= time1Mins && trips[j].startMins <= 1439) || (trips[j].startMins >= 0 && trips[j].startMins <= time2Mins)){ 
-                // updates trips, duration, and calls tripFoundAtStation to store boolean true in stationInfo struct stations array
-                countTrips += 1;
-                totalDuration += (trips[j].duration)/(60.0); // minute conversion
-                tripFoundAtStation(stations, trips[j].startStatID, S);
-                
-            }
-        } else { // time1 < time2
-            if(trips[j].startMins >= time1Mins && trips[j].startMins <= time2Mins){
-                countTrips += 1;
-                totalDuration += (trips[j].duration)/(60.0); // minute conversion
-                tripFoundAtStation(stations, trips[j].startStatID, S);
-            }
+void runBenchmark(const divvyData& data, const loadTimings& load, int runs, ostream& out){
+    vector<pair<string, vector<command>>> suites;
+    benchmarkCommands(data, runs, suites);
+    
+    double loadSeconds = max(load.loadSeconds, 1e-9);
+    out << "{" << endl;
+    out << "  \"stations\": " << data.numOfStations << "," << endl;
+    out << "  \"trips\": " << data.numOfTrips << "," << endl;
+    out << "  \"threads\": " << load.numThreads << "," << endl;
+    out << "  \"scan_threads\": " << data.scanThreads << "," << endl;
+    out << "  \"load\": {\"seconds\": " << load.loadSeconds << ", \"rows_per_sec\": " << (long long)(data.numOfTrips / loadSeconds);
+    out << ", \"mb_per_sec\": " << (load.bytes / (1024.0 * 1024.0)) / loadSeconds << ", \"index_seconds\": " << load.indexSeconds << "}," << endl;
+    out << "  \"commands\": {" << endl;
+    
+    ostringstream buffer;
+    for (size_t s = 0; s < suites.size(); ++s){
+        const vector<command>& commands = suites[s].second;
+        vector<double> millis;
+        double totalSeconds = 0.0;
+        for (const command& cmd : commands){
+            buffer.str("");
+            auto start = chrono::steady_clock::now();
+            runCommand(data, cmd, buffer);
+            chrono::duration<double> seconds = chrono::steady_clock::now() - start;
+            millis.push_back(seconds.count() * 1000.0);
+            totalSeconds += seconds.count();
         }
+        sort(millis.begin(), millis.end());
+        
+        double median = millis.empty() ? 0.0 : millis[millis.size() / 2];
+        double p99 = millis.empty() ? 0.0 : millis[(size_t)ceil(0.99 * millis.size()) - 1];
+        out << "    \"" << suites[s].first << "\": {\"runs\": " << millis.size() << ", \"median_ms\": " << median;
+        out << ", \"p99_ms\": " << p99 << ", \"per_sec\": " << (totalSeconds > 0.0 ? millis.size() / totalSeconds : 0.0) << "}";
+        out << (s + 1 < suites.size() ? "," : "") << endl;
     }
+    
+    out << "  }" << endl;
+    out << "}" << endl;
 }
 
 
-//
-// tripsInTimeSpan
-//
-// Given stationInfo struct stations array, tripInfo struct trips array, and total # of stations, total # of trips,
-// it gets userinput for time1 and time2 and converts into minutes(int). Stores time in startMins of trips array. 
-// Outputs either none found or stations name, avg duration, and trips. No return type.
-//
-void tripsInTimeSpan(stationInfo stations[], tripInfo trips[], int S, int T){
-    string time1, time2;
+int main(int argc, char* argv[]){
     
-    cin >> time1;
-    cin >> time2;
-    
-    // find time1 and time2 in minutes
-    int colonIndex1 = time1.find(":");
-    int colonIndex2 = time2.find(":");
-    int hour1 = stoi(time1.substr(0, colonIndex1));
-    int hour2 = stoi(time2.substr(0, colonIndex2));
-    int minIndex1 = ++colonIndex1;
-    int minIndex2 = ++colonIndex2;
-    int min1 = stoi(time1.substr(minIndex1));
-    int min2 = stoi(time2.substr(minIndex2));
-    int Time1InMins = (60 * hour1) + min1;
-    int Time2InMins = (60 * hour2) + min2;
+    // command-line flags
+    bool showLoadReport = false;
+    int numThreads = max((int)thread::hardware_concurrency(), 1);
+    int scanThreads = 0; // threads per scan inside a command, 0 to pick (see below)
+    string snapshotFileName; // load from this snapshot instead of the text files
+    string saveSnapshotFileName; // write the loaded data to this snapshot
+    bool streaming = false; // fold the trips into aggregates chunk by chunk instead of keeping them
+    int chunkMB = 64;
+    string batchFileName; // run the commands in this script ("-" for stdin) instead of prompting for them
+    int benchRuns = 0; // time this many runs of each command and print a JSON report instead of prompting
+    string serveUnixPath; // serve the commands on this Unix socket instead of prompting for them
+    int serveTcpPort = 0; // or on this loopback TCP port
+    int cacheMB = 64; // keep up to this much command output to answer repeated commands from, 0 for none
+    int cachePrecision = -1; // round nearme coordinates to this many decimals for the cache, -1 to leave them
+    string stationsFileName;
+    string biketripsFileName;
+    for (int i = 1; i < argc; ++i){
+        string flag = argv[i];
+        if (flag == "--load-report"){
+            showLoadReport = true;
+        } else if (flag == "--threads" && i + 1 < argc && parseInt(argv[i + 1], numThreads) && numThreads > 0){
+            ++i;
+        } else if (flag == "--scan-threads" && i + 1 < argc && parseInt(argv[i + 1], scanThreads) && scanThreads > 0){
+            ++i;
+        } else if (flag == "--snapshot" && i + 1 < argc){
+            snapshotFileName = argv[++i];
+        } else if (flag == "--save-snapshot" && i + 1 < argc){
+            saveSnapshotFileName = argv[++i];
+        } else if (flag == "--stream"){
+            streaming = true;
+        } else if (flag == "--chunk-mb" && i + 1 < argc && parseInt(argv[i + 1], chunkMB) && chunkMB > 0){
+            ++i;
+        } else if (flag == "--batch" && i + 1 < argc){
+            batchFileName = argv[++i];
+        } else if (flag == "--bench" && i + 1 < argc && parseInt(argv[i + 1], benchRuns) && benchRuns > 0){
+            ++i;
+        } else if (flag == "--serve-unix" && i + 1 < argc){
+            serveUnixPath = argv[++i];
+        } else if (flag == "--serve-tcp" && i + 1 < argc && parseInt(argv[i + 1], serveTcpPort) && serveTcpPort > 0 && serveTcpPort < 65536){
+            ++i;
+        } else if (flag == "--cache-mb" && i + 1 < argc && parseInt(argv[i + 1], cacheMB) && cacheMB >= 0){
+            ++i;
+        } else if (flag == "--cache-precision" && i + 1 < argc && parseInt(argv[i + 1], cachePrecision) && cachePrecision >= 0 && cachePrecision <= 12){
+            ++i;
+        } else if (flag == "--stations" && i + 1 < argc){
+            stationsFileName = argv[++i];
+        } else if (flag == "--trips" && i + 1 < argc){
+            biketripsFileName = argv[++i];
+        } else {
+            cerr << "**Error: unknown option '" << flag << "'" << endl;
+            return 1;
+        }
+    }
+#ifdef DIVVY_PROFILE
+    if (getenv("DIVVY_PROFILE") != nullptr){ // DIVVY_PROFILE=table or json dumps the profile to cerr at exit
+        atexit(profileAtExit);
+    }
+#endif
+    if (streaming && (!snapshotFileName.empty() || !saveSnapshotFileName.empty())){
+        cerr << "**Error: --stream doesn't keep the trips, so it can't be used with snapshots" << endl;
+        return 1;
+    }
     
-    int countTrips = 0;
-    double duration = 0.0;
+    // batch, benchmark and server modes print only the command output (or report), so the banner, prompts and errors are
+    // left out of stdout
+    bool serving = !serveUnixPath.empty() || serveTcpPort > 0;
+    bool batch = !batchFileName.empty() || benchRuns > 0 || serving;
+    if (scanThreads == 0){ // batch and server modes already run commands side by side, one per thread
+        scanThreads = (!batchFileName.empty() || serving) ? 1 : numThreads;
+    }
+    ifstream batchFile;
+    if (!batchFileName.empty() && batchFileName != "-"){
+        batchFile.open(batchFileName);
+        if (!batchFile.good()){
+            cerr << "**Error: unable to open batch file '" << batchFileName << "'" << endl;
+            return 1;
+        }
+    }
+    ostream& messages = batch ? cerr : cout;
     
-    // storing time in startMins of trips array
-    for(int i = 0; i < T; ++i){
-        string startTime = trips[i].startTime;
-        int colonIndex = startTime.find(":");
-        int hour = stoi(startTime.substr(0, colonIndex));
-        int minIndex = ++colonIndex;
-        int min = stoi(startTime.substr(minIndex));
-        trips[i].startMins = (60 * hour) + min;
+    if (!batch){
+        cout << "** Divvy Bike Data Analysis **" << endl;
     }
     
-    countTripsAndDuration(stations, trips, S, T, Time1InMins, Time2InMins, countTrips, duration); // updates trips and duration vars
+    int numOfStations;
+    int numOfTrips;
+    stationInfo* stations = nullptr;
+    textArena stationText; // the stations' IDs and names (text mode only; a snapshot's stations point into the snapshot)
+    stationDictionary dictionary;
+    tripColumns trips;
+    mappedFile inputBikeTripsFile = {nullptr, 0, false, 0}; // the trips file or the snapshot; stays mapped since trips refer into it
+    size_t bytesLoaded = 0;
+    
+    tripTotals totals; // streaming mode only
+    datasetIndexes indexes; // built below, or loaded with a snapshot
+    stationTripCounts& stationTrips = indexes.stationTrips;
+    stationTrips.countedTrips = 0;
+    timeIndex& tripTimes = indexes.tripTimes;
     
-    if(countTrips > 0){
-        cout << " " << countTrips << " trips found" << endl;
-        cout << " avg duration: " << floor(duration/countTrips) << " minutes" << endl;
+    auto loadStart = chrono::steady_clock::now();
+    if (!snapshotFileName.empty()){
+        // (1, 2) map the snapshot and take the stations, station dictionary, trip columns and indexes straight from it
+        string problem = loadSnapshot(snapshotFileName, inputBikeTripsFile, stations, numOfStations, dictionary, trips, numOfTrips, indexes);
+        if (!problem.empty()){
+            messages << "**Error: " << problem << endl;
+            return batch ? 1 : 0;
+        }
+        bytesLoaded = inputBikeTripsFile.size;
+    } else {
+        // (1) input stations and biketrips file and error check
+        ifstream inputStationsFile;
         
-        bubbleSortByName(stations, S);
-        cout << " stations where trip started: ";
+        if (stationsFileName.empty()){
+            if (!batch){
+                cout << "Please enter name of stations file> " << endl;
+            }
+            cin >> stationsFileName;
+        }
         
-        int countStations = 0; // acts as an indicator for adding comma and space if more than 1 trip exists
-        for(int i = 0; i < S; ++i){
-            if(stations[i].tripFound == true){
-                if(countStations >= 1){ // add comma and space for more than 1 station names
-                    cout << ", ";
-                }
-                cout << stations[i].name;
-                countStations++;
+        inputStationsFile.open(stationsFileName);
+        if (!inputStationsFile.good()) { // error check stations file
+            messages << "**Error: unable to open input file '" << stationsFileName << "'" << endl;
+            return batch ? 1 : 0;
+        }
+        
+        if (biketripsFileName.empty()){
+            if (!batch){
+                cout << "Please enter name of bike trips file> " << endl;
             }
+            cin >> biketripsFileName;
         }
-        cout << endl;
         
-    } else {
-        cout << "none found" << endl;
+        ifstream inputBikeTripsStream; // streaming mode reads the file in chunks instead of mapping it
+        if (streaming){
+            inputBikeTripsStream.open(biketripsFileName, ios::binary);
+        }
+        if (streaming ? !inputBikeTripsStream.good() : !mapInputFile(biketripsFileName, inputBikeTripsFile)) { // error check biketrips file
+            messages << "**Error: unable to open input file '" << biketripsFileName << "'" << endl;
+            return batch ? 1 : 0;
+        }
+        
+        // (2) inputting and storing data in a dynamically-allocated stations array and the trip columns
+        inputStationsFile >> numOfStations;
+        stations = new stationInfo[numOfStations];
+        struct stat stationsStat; // all the stations' text fits in the size of the file, so it goes into one arena block
+        if (stat(stationsFileName.c_str(), &stationsStat) == 0){
+            arenaReserve(stationText, stationsStat.st_size);
+        }
+        storeStationValues(inputStationsFile, stations, numOfStations, stationText);
+        inputStationsFile.close();
+        
+        buildStationDictionary(stations, numOfStations, dictionary);
+        
+        loadStart = chrono::steady_clock::now(); // the mapping is lazy, so this times page-in plus parsing
+        if (streaming){
+            size_t chunkBytes = (size_t)chunkMB << 20;
+            numOfTrips = streamBikeTrips(inputBikeTripsStream, chunkBytes, dictionary, numThreads, totals, stationTrips, tripTimes, bytesLoaded);
+        } else {
+            numOfTrips = storeBikeTripValues(inputBikeTripsFile, trips, dictionary, numThreads, nullptr);
+            sortTripsByStart(trips, numOfTrips); // a snapshot is saved already sorted
+            bytesLoaded = inputBikeTripsFile.size;
+        }
     }
     
-    // resetting the tripFound value to false after the program finishes outputting
-    for (int i = 0; i < S; ++i){
-        stations[i].tripFound = false;
+    chrono::duration<double> loadSeconds = chrono::steady_clock::now() - loadStart;
+    if (showLoadReport){
+        loadReport(numOfTrips, bytesLoaded, loadSeconds.count(), inputBikeTripsFile.isMapped, numThreads);
     }
     
-}
-
-
-int main(){
+    // names never change, so the name order is computed once here and shared by all commands. A snapshot brought these
+    // indexes with it
+    auto indexStart = chrono::steady_clock::now();
+    vector<int>& nameOrder = indexes.nameOrder;
+    nameIndex& names = indexes.names;
+    vector<tripPartition>& partitions = indexes.partitions;
+    routeMatrix& routes = indexes.routes;
+    bikeTimeline& bikes = indexes.bikes;
+    if (snapshotFileName.empty()){
+        sortStationsByName(stations, numOfStations, nameOrder);
+        buildNameIndex(stations, nameOrder, names);
+        
+        if (!streaming){ // streaming mode built these as it went
+            buildTripPartitions(trips, numOfTrips, partitions);
+            updateStationTripCounts(trips, numOfTrips, dictionary.ids.size(), numThreads, stationTrips);
+            buildTimeIndex(trips, numOfTrips, dictionary.ids.size(), tripTimes);
+        }
+        
+        if (streaming){
+            buildRouteMatrixFromTotals(totals, dictionary.ids.size(), routes);
+        } else {
+            buildRouteMatrix(trips, numOfTrips, dictionary.ids.size(), numThreads, routes);
+        }
+        
+        if (!streaming){ // streaming mode dropped the bike IDs with their chunks
+            buildBikeTimeline(trips, numOfTrips, dictionary.ids.size(), bikes);
+        }
+    }
     
-    // (1) input stations and biketrips file and error check
-    string biketripsFileName;
-    string stationsFileName;
+    stationGrid grid;
+    buildStationGrid(stations, numOfStations, grid);
+    
+    vector<int> stationAt(dictionary.ids.size(), -1);
+    for (int i = 0; i < numOfStations; ++i){
+        stationAt[stations[i].index] = i;
+    }
+    chrono::duration<double> indexSeconds = chrono::steady_clock::now() - indexStart;
     
-    ifstream inputBikeTripsFile;
-    ifstream inputStationsFile;
+    if (!saveSnapshotFileName.empty() && !saveSnapshot(saveSnapshotFileName, stations, numOfStations, dictionary, trips, numOfTrips, indexes)){
+        messages << "**Error: unable to write snapshot file '" << saveSnapshotFileName << "'" << endl;
+    }
     
-    cout << "** Divvy Bike Data Analysis **" << endl;
+    divvyData data;
+    data.stations = stations;
+    data.numOfStations = numOfStations;
+    data.numOfTrips = numOfTrips;
+    data.dictionary = &dictionary;
+    data.trips = &trips;
+    data.nameOrder = &nameOrder;
+    data.grid = &grid;
+    data.names = &names;
+    data.stationTrips = &stationTrips;
+    data.tripTimes = &tripTimes;
+    data.routes = &routes;
+    data.bikes = &bikes;
+    data.partitions = &partitions;
+    data.stationAt = &stationAt;
+    data.totals = streaming ? &totals : nullptr;
+    data.scanThreads = scanThreads;
+    resultCache cache;
+    cache.bytes = 0;
+    cache.maxBytes = (size_t)cacheMB << 20;
+    cache.precision = cachePrecision;
+    cache.generation = 0;
+    cache.hits = 0;
+    cache.misses = 0;
+    data.cache = cacheMB > 0 ? &cache : nullptr;
     
-    cout << "Please enter name of stations file> " << endl;
-    cin >> stationsFileName;
+    tripIngest ingest;
+    ingest.dictionary = &dictionary;
+    ingest.trips = &trips;
+    ingest.stationTrips = &stationTrips;
+    ingest.tripTimes = &tripTimes;
+    ingest.routes = &routes;
+    ingest.bikes = &bikes;
+    ingest.partitions = &partitions;
+    ingest.totals = streaming ? &totals : nullptr;
+    ingest.numThreads = numThreads;
+    ingest.dataLock = nullptr; // batch mode runs an append on its own, and the server sets its lock
+    if (!biketripsFileName.empty()){
+        ingest.bytesRead[biketripsFileName] = bytesLoaded; // appending the trips file again reads only what it gained
+    }
     
-    inputStationsFile.open(stationsFileName);
-    if (!inputStationsFile.good()) { // error check stations file
-        cout << "**Error: unable to open input file '" << stationsFileName << "'" << endl;
+    if (benchRuns > 0){
+        loadTimings load;
+        load.bytes = bytesLoaded;
+        load.loadSeconds = loadSeconds.count();
+        load.indexSeconds = indexSeconds.count();
+        load.numThreads = numThreads;
+        runBenchmark(data, load, benchRuns, cout);
+        delete[] stations;
+        unmapInputFile(inputBikeTripsFile);
         return 0;
     }
     
-    cout << "Please enter name of bike trips file> " << endl;
-    cin >> biketripsFileName;
+    if (serving){
+        int exitCode = runServer(data, ingest, serveUnixPath, serveTcpPort, numThreads);
+        delete[] stations;
+        unmapInputFile(inputBikeTripsFile);
+        for (mappedFile& file : ingest.files){
+            unmapInputFile(file);
+        }
+        return exitCode;
+    }
     
-    inputBikeTripsFile.open(biketripsFileName);
-    if (!inputBikeTripsFile.good()) { // error check biketrips file
-        cout << "**Error: unable to open input file '" << biketripsFileName << "'" << endl;
+    if (batch){
+        runBatch(data, ingest, batchFileName == "-" ? cin : batchFile, numThreads, cout);
+        delete[] stations;
+        unmapInputFile(inputBikeTripsFile);
+        for (mappedFile& file : ingest.files){
+            unmapInputFile(file);
+        }
         return 0;
     }
     
-    // (2) inputting and storing data in two dynamically-allocated arrays
-    int numOfStations;
-    int numOfTrips;
-    
-    inputStationsFile >> numOfStations;
-    inputBikeTripsFile >> numOfTrips;
-    
-    stationInfo* stations = new stationInfo[numOfStations];
-    tripInfo* trips = new tripInfo[numOfTrips];
-    
-    storeStationValues(inputStationsFile, stations, numOfStations);
-    storeBikeTripValues(inputBikeTripsFile, trips, numOfTrips);
-    
-    // closing files after storing in the two arrays
-    inputStationsFile.close(); 
-    inputBikeTripsFile.close();
-    
     // (3) getting userCommand and executing them until they enter "#"
-    string userCommand = "";
-    while(userCommand != "#"){
+    command userCommand;
+    while(true){
         cout << "Enter command (# to stop)> ";
         
-        cin >> userCommand;
-
-        if (userCommand == "#") {
+        if (!readCommand(cin, userCommand) || userCommand.name == "#") {
             break; // exits loop
-        } else if (userCommand == "stats") {
-            quickStats(numOfStations, numOfTrips, stations);
-        } else if (userCommand == "durations") {
-            durations(numOfTrips, trips);
-        } else if (userCommand == "starting") {
-            startingTimes(numOfTrips, trips);
-        } else if (userCommand == "nearme") {
-            stationsNearMe(stations, numOfStations);
-        } else if (userCommand == "stations") {
-            listAllStations(stations, trips, numOfStations, numOfTrips);
-        } else if (userCommand == "find") {
-            findStations(stations, trips, numOfStations, numOfTrips);
-        } else if (userCommand == "trips") {
-            tripsInTimeSpan(stations, trips, numOfStations, numOfTrips);
+        }
+        if (userCommand.name == "append"){
+            runAppend(ingest, data, userCommand.args[0], cout);
         } else {
-            cout << "** Invalid command, try again..." << endl;
+            runCachedCommand(data, userCommand, cout);
         }
     }
     cout << "** Done **" << endl;
     
     delete[] stations;
-    delete[] trips;
+    unmapInputFile(inputBikeTripsFile);
+    for (mappedFile& file : ingest.files){
+        unmapInputFile(file);
+    }
     return 0;
     
 }
\ No newline at end of file